@@ -1,16 +1,37 @@
 #include "Config.h"
 #include "Event.h"
 #include "LLMoney.h"
+#include "Ledger.h"
+#include "LedgerServer.h"
 #include "LegacyMoney.h"
+#include "Maintenance.h"
+#include "RankingCache.h"
+#include "RemoteLedger.h"
+#include "Trace.h"
+#include "Worker.h"
 #include "ll/api/service/PlayerInfo.h"
 #include "sqlitecpp/SQLiteCpp.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 
-static std::unique_ptr<SQLite::Database> db;
+static std::unique_ptr<legacy_money::Store>        store;
+static legacy_money::Ledger*                        ledger = nullptr; // The store, unless it is remote
+static std::unique_ptr<legacy_money::LedgerServer> server;
+static std::unique_ptr<legacy_money::TraceWriter>  tracer;
+static std::unique_ptr<legacy_money::Worker>       worker;
+static std::unique_ptr<legacy_money::RankingCache> rankingCache;
+static std::unique_ptr<legacy_money::Maintenance>  maintenance;
 #undef snprintf
 
 struct cleanSTMT {
@@ -26,243 +47,687 @@ struct cleanSTMT {
 
 void ConvertData();
 namespace legacy_money {
-bool initDatabase() {
+// Records one exported call into the trace, if tracing is enabled, when it goes out of scope.
+class TraceCall {
+public:
+    TraceCall(
+        TraceOp            op,
+        std::string const& xuid     = {},
+        std::string const& to       = {},
+        long long          value    = 0,
+        std::string const& note     = {},
+        std::string const& currency = {},
+        std::string const& key      = {}
+    ) {
+        if (tracer) {
+            auto thread = (uint32_t)std::hash<std::thread::id>{}(std::this_thread::get_id());
+            mRecord     = TraceRecord{op, tracer->now(), 0, thread, xuid, to, value, note, 0, currency, key};
+        }
+    }
+
+    ~TraceCall() {
+        if (mRecord && tracer) {
+            mRecord->duration = tracer->now() - mRecord->time;
+            tracer->write(*mRecord);
+        }
+    }
+
+    template <class T>
+    T done(T result) {
+        if (mRecord) {
+            if constexpr (std::is_floating_point_v<T>) {
+                mRecord->result = (long long)(result * 1e6);
+            } else if constexpr (std::is_arithmetic_v<T>) {
+                mRecord->result = (long long)result;
+            } else {
+                mRecord->result = (long long)result.size();
+            }
+        }
+        return result;
+    }
+
+    // A before listener refused the call, so it never reached the ledger.
+    bool vetoed() {
+        if (mRecord) {
+            mRecord->vetoed = true;
+        }
+        return false;
+    }
+
+    void setExchange(std::string const& toCurrency, long long toValue) {
+        if (mRecord) {
+            mRecord->toCurrency = toCurrency;
+            mRecord->toValue    = toValue;
+        }
+    }
+
+    void setRange(long long min, long long max) {
+        if (mRecord) {
+            mRecord->min = min;
+            mRecord->max = max;
+        }
+    }
+
+private:
+    std::optional<TraceRecord> mRecord;
+};
+
+// The empty id is the default currency, configured by the top-level fields.
+static bool knownCurrency(std::string const& currency) {
+    return currency.empty() || getConfig().currencies.contains(currency);
+}
+
+static std::string const& currencySymbol(std::string const& currency) {
+    auto it = getConfig().currencies.find(currency);
+    return it == getConfig().currencies.end() ? getConfig().currency_symbol : it->second.currency_symbol;
+}
+
+static std::vector<std::string> currencyIds() {
+    std::vector<std::string> rv{{}};
+    for (auto const& [id, currency] : getConfig().currencies) {
+        rv.push_back(id);
+    }
+    return rv;
+}
+
+using HistRecord = HistEntry;
+
+// Recent transactions of an online player, oldest first. Every mtrans row involving the player with
+// Time > coveredAfter is present, so queries whose window starts at or after coveredAfter can skip SQLite.
+struct HistRing {
+    std::deque<HistRecord> records;
+    long long              coveredAfter;
+};
+
+// xuid -> currency -> recent transactions
+static std::unordered_map<std::string, std::unordered_map<std::string, HistRing>> histCache;
+static std::mutex                                                                 histMutex;
+
+static void pushHist(HistRing& ring, HistRecord record) {
+    ring.records.push_back(std::move(record));
+    while (ring.records.size() > (size_t)std::max(getConfig().hist_cache_size, 0)) {
+        ring.coveredAfter = std::max(ring.coveredAfter, ring.records.front().time);
+        ring.records.pop_front();
+    }
+}
+
+// Runs inside the ledger lock, right after the transfer is committed.
+static void recordHist(HistRecord const& record) {
+    std::lock_guard lock{histMutex};
+    if (histCache.empty()) {
+        return;
+    }
+    for (auto const* xuid : {&record.from, &record.to}) {
+        if (xuid->empty()) {
+            continue;
+        }
+        if (auto rings = histCache.find(*xuid); rings != histCache.end()) {
+            if (auto it = rings->second.find(record.currency); it != rings->second.end()) {
+                pushHist(it->second, record);
+            }
+        }
+    }
+}
+
+// Transfers made by other instances of a shared ledger are not seen here, so only a local ledger is cached.
+static void cacheHist(std::string const& xuid) {
+    if (xuid.empty() || getConfig().hist_cache_size <= 0 || !ledger) {
+        return;
+    }
     try {
-        db = std::make_unique<SQLite::Database>(
-            LegacyMoney::getInstance().getSelf().getModDir() / "economy.db",
-            SQLite::OPEN_CREATE | SQLite::OPEN_READWRITE
-        );
-        db->exec("PRAGMA journal_mode = MEMORY");
-        db->exec("PRAGMA synchronous = NORMAL");
-        db->exec("CREATE TABLE IF NOT EXISTS money ( \
-			XUID  TEXT PRIMARY KEY \
-			UNIQUE \
-			NOT NULL, \
-			Money NUMERIC NOT NULL \
-		) \
-			WITHOUT ROWID; ");
-        db->exec("CREATE TABLE IF NOT EXISTS mtrans ( \
-			tFrom TEXT  NOT NULL, \
-			tTo   TEXT  NOT NULL, \
-			Money NUMERIC  NOT NULL, \
-			Time  NUMERIC NOT NULL \
-			DEFAULT(strftime('%s', 'now')), \
-			Note  TEXT \
-		);");
-        db->exec("CREATE INDEX IF NOT EXISTS idx ON mtrans ( \
-			Time COLLATE BINARY COLLATE BINARY DESC \
-		); ");
+        // Keep transfers from committing between the query and the insertion, or they would be lost.
+        auto      ledgerLock = ledger->lock();
+        long long after      = std::time(nullptr) - getConfig().hist_cache_window;
+
+        std::unordered_map<std::string, HistRing> rings;
+        for (auto const& currency : currencyIds()) {
+            auto     entries = ledger->hist(currency, xuid, after, getConfig().hist_cache_size);
+            HistRing ring{{std::make_move_iterator(entries.rbegin()), std::make_move_iterator(entries.rend())}, after};
+            if (ring.records.size() >= (size_t)getConfig().hist_cache_size) {
+                ring.coveredAfter = ring.records.front().time;
+            }
+            rings[currency] = std::move(ring);
+        }
+        std::lock_guard histLock{histMutex};
+        histCache[xuid] = std::move(rings);
     } catch (std::exception const& e) {
-        LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}", e.what());
-        return false;
+        LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
     }
-    ConvertData();
-    return true;
 }
-} // namespace legacy_money
 
-long long LLMoney_Get(std::string xuid) {
+// Loads the balance and recent history of a joining player in the background, so their first command is served
+// from memory. Release is queued behind it so a quick disconnect cannot leave the account pinned.
+void prefetchPlayer(std::string const& xuid) {
     if (xuid.empty()) {
-        return -1;
+        return;
     }
-    try {
-        SQLite::Statement get{*db, "select Money from money where XUID=?"};
-        get.bindNoCopy(1, xuid);
-        long long rv = legacy_money::getConfig().def_money;
-        bool      fg = false;
-        while (get.executeStep()) {
-            rv = (long long)get.getColumn(0).getInt64();
-            fg = true;
+    worker->post([xuid] {
+        auto begin = std::chrono::steady_clock::now();
+        try {
+            store->prefetch(xuid);
+        } catch (std::exception const& e) {
+            LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
         }
-        get.reset();
-        get.clearBindings();
-        if (!fg) {
-            SQLite::Statement set{*db, "insert into money values (?,?)"};
-            set.bindNoCopy(1, xuid);
-            set.bind(2, legacy_money::getConfig().def_money);
-            set.exec();
-            set.reset();
-            set.clearBindings();
+        cacheHist(xuid);
+        LegacyMoney::getInstance().getSelf().getLogger().debug(
+            "Prefetched {} in {}us",
+            xuid,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count()
+        );
+    });
+}
+
+void releasePlayer(std::string const& xuid) {
+    if (xuid.empty()) {
+        return;
+    }
+    worker->post([xuid] {
+        store->release(xuid);
+        std::lock_guard lock{histMutex};
+        histCache.erase(xuid);
+    });
+}
+
+static std::string formatHist(HistRecord const& record) {
+    std::string              fromName, toName = "System";
+    ll::service::PlayerInfo& info      = ll::service::PlayerInfo::getInstance();
+    auto                     fromEntry = record.from.empty() ? std::nullopt : info.fromXuid(record.from);
+    auto                     toEntry   = record.to.empty() ? std::nullopt : info.fromXuid(record.to);
+    if (fromEntry) {
+        fromName = fromEntry->name;
+    }
+    if (toEntry) {
+        toName = toEntry->name;
+    }
+    std::time_t t = record.time;
+    std::tm     tm{};
+    localtime_s(&tm, &t);
+    char time[32];
+    std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", &tm);
+    return fromName + " -> " + toName + " " + std::to_string(record.money) + " " + time + " (" + record.note + ")\n";
+}
+
+static std::optional<std::string>
+getCachedHist(std::string const& currency, std::string const& xuid, int timediff) {
+    std::lock_guard lock{histMutex};
+    auto            rings = histCache.find(xuid);
+    if (rings == histCache.end()) {
+        return std::nullopt;
+    }
+    auto it = rings->second.find(currency);
+    if (it == rings->second.end()) {
+        return std::nullopt;
+    }
+    long long after = std::time(nullptr) - timediff;
+    if (after < it->second.coveredAfter) {
+        return std::nullopt;
+    }
+    std::string rv;
+    for (auto record = it->second.records.rbegin(); record != it->second.records.rend(); ++record) {
+        if (record->time <= after) {
+            break;
+        }
+        rv += formatHist(*record);
+    }
+    return rv;
+}
+
+// Forgets the cached records up to time through, which have been deleted from the ledger. Older queries go to the
+// ledger from then on, since it may have kept some of the records at that very second.
+static void dropCachedHist(long long through) {
+    std::lock_guard lock{histMutex};
+    for (auto& [xuid, rings] : histCache) {
+        for (auto& [currency, ring] : rings) {
+            while (!ring.records.empty() && ring.records.front().time <= through) {
+                ring.records.pop_front();
+            }
+            ring.coveredAfter = std::max(ring.coveredAfter, through);
         }
-        return rv;
-    } catch (std::exception const& e) {
-        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
-        return -1;
     }
 }
 
-bool isRealTrans = true;
+static void clearCachedHist(int difftime) { dropCachedHist(std::time(nullptr) - difftime - 1); }
 
-bool LLMoney_Trans(std::string from, std::string to, long long val, std::string const& note) {
-    bool isRealTrans = ::isRealTrans;
-    ::isRealTrans    = true;
-    if (isRealTrans) {
-        if (!CallBeforeEvent(LLMoneyEvent::Trans, from, to, val)) {
+// Rankings are read at a ledger epoch when there is a local ledger to ask. The epoch is read before the ranking, so
+// a transfer racing with the query can only make the cached result look older than it is.
+static std::shared_ptr<RankingCache::Entry const>
+getRanking(std::string const& currency, unsigned short num, bool render) {
+    auto epoch = ledger ? std::optional{ledger->epoch()} : std::nullopt;
+    if (auto cached = rankingCache->find(currency, num, epoch); cached && (!render || cached->lines)) {
+        return cached;
+    }
+    auto entry  = std::make_shared<RankingCache::Entry>();
+    entry->rows = store->ranking(currency, num);
+    if (render) {
+        entry->lines.emplace();
+        for (auto const& [xuid, money] : entry->rows) {
+            if (auto info = ll::service::PlayerInfo::getInstance().fromXuid(xuid)) {
+                entry->lines->push_back(info->name + " " + currencySymbol(currency) + std::to_string(money));
+            }
+        }
+    }
+    rankingCache->insert(currency, num, epoch, entry);
+    return entry;
+}
+
+// The lines /money top prints for the num richest players.
+std::vector<std::string> renderRanking(unsigned short num) {
+    try {
+        return *getRanking({}, num, true)->lines;
+    } catch (std::exception const& e) {
+        LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return {};
+    }
+}
+
+bool initDatabase() {
+    auto& logger = LegacyMoney::getInstance().getSelf().getLogger();
+    rankingCache = std::make_unique<RankingCache>(std::chrono::milliseconds{getConfig().ranking_cache_ms});
+    if (getConfig().ledger_mode == "client") {
+        store = std::make_unique<RemoteLedger>(
+            getConfig().ledger_address,
+            std::chrono::milliseconds{getConfig().remote_cache_ms},
+            std::chrono::milliseconds{getConfig().remote_timeout_ms}
+        );
+        logger.info("Using the shared ledger at {}", getConfig().ledger_address);
+    } else {
+        try {
+            auto local = std::make_unique<Ledger>(LegacyMoney::getInstance().getSelf().getModDir() / "economy.db");
+            local->setOptions({}, {getConfig().def_money, getConfig().pay_tax});
+            for (auto const& [id, currency] : getConfig().currencies) {
+                local->setOptions(id, {currency.def_money, currency.pay_tax});
+            }
+            local->setKeyTtl(getConfig().trans_key_ttl);
+            local->setTransListener(recordHist);
+            local->setBalanceListener(
+                [](std::string const& currency, std::string const& xuid, long long money, uint64_t epoch) {
+                    rankingCache->update(currency, xuid, money, epoch);
+                }
+            );
+            ledger = local.get();
+            store  = std::move(local);
+        } catch (std::exception const& e) {
+            logger.error("Database error: {}", e.what());
             return false;
         }
+        ConvertData();
     }
-    if (val < 0 || from == to) {
-        return false;
+    return true;
+}
+
+// Every session records to a file of its own, named after trace_file and the time it started, so a restart does not
+// overwrite what the previous one recorded.
+static std::filesystem::path tracePath(std::filesystem::path const& configured) {
+    std::time_t t = std::time(nullptr);
+    std::tm     tm{};
+    localtime_s(&tm, &t);
+    char started[32];
+    std::strftime(started, sizeof(started), "%Y%m%d-%H%M%S", &tm);
+    auto stem = configured.parent_path() / (configured.stem().string() + "-" + started);
+    auto path = std::filesystem::path{stem.string() + configured.extension().string()};
+    for (int i = 2; std::filesystem::exists(path); ++i) {
+        path = stem.string() + "-" + std::to_string(i) + configured.extension().string();
     }
-    try {
-        db->exec("begin");
-        SQLite::Statement set{*db, "update money set Money=? where XUID=?"};
-        if (!from.empty()) {
-            auto fmoney = LLMoney_Get(from);
-            if (fmoney < val) {
-                db->exec("rollback");
-                return false;
+    return path;
+}
+
+// Starts what closeDatabase() stops, so the mod can be disabled and enabled again.
+void startDatabase() {
+    auto& logger = LegacyMoney::getInstance().getSelf().getLogger();
+    worker       = std::make_unique<Worker>();
+    if (ledger && getConfig().ledger_mode == "server") {
+        try {
+            server = std::make_unique<LedgerServer>(*ledger, getConfig().ledger_address);
+            logger.info("Serving the shared ledger on {}", getConfig().ledger_address);
+        } catch (std::exception const& e) {
+            logger.error("Failed to start the ledger server: {}", e.what());
+        }
+    }
+    if (!getConfig().trace_file.empty()) {
+        auto path = tracePath(LegacyMoney::getInstance().getSelf().getModDir() / getConfig().trace_file);
+        tracer    = std::make_unique<TraceWriter>(path);
+        logger.info("Recording calls to {}", path.string());
+        if (!tracer->good()) {
+            logger.error("Failed to open trace file {}", path.string());
+            tracer.reset();
+        }
+    }
+}
+
+// Runs maintenance on the worker after delay, then again every maintenance_interval. A run that ran out of budget
+// is picked up again a second later rather than after a whole interval. Runs re-arm themselves on the worker they run
+// on, which outlives them, instead of reading the global that closeDatabase() clears before the worker is joined.
+static void scheduleMaintenance(Worker& on, std::chrono::steady_clock::duration delay) {
+    on.postAt(std::chrono::steady_clock::now() + delay, [&on] {
+        auto& logger = LegacyMoney::getInstance().getSelf().getLogger();
+        bool  done   = true;
+        try {
+            auto report = maintenance->run();
+            if (report.deletedRows > 0) {
+                dropCachedHist(report.newestDeleted);
             }
-            fmoney -= val;
-            {
-                set.bindNoCopy(2, from);
-                set.bind(1, fmoney);
-                set.exec();
-                set.reset();
-                set.clearBindings();
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(report.spent).count();
+            if (report.deletedRows > 0 || report.expiredKeys > 0 || report.reclaimedBytes > 0 || report.optimized) {
+                logger.info(
+                    "Maintenance deleted {} history records and {} transfer keys, reclaimed {} bytes, checkpointed {} "
+                    "WAL bytes in {}ms",
+                    report.deletedRows,
+                    report.expiredKeys,
+                    report.reclaimedBytes,
+                    report.walBytes,
+                    ms
+                );
+            } else {
+                logger.debug("Maintenance checkpointed {} bytes of WAL in {}ms", report.walBytes, ms);
             }
+            done = report.finished;
+        } catch (std::exception const& e) {
+            logger.error("Database error: {}\n", e.what());
         }
-        if (!to.empty()) {
-            auto tmoney = LLMoney_Get(to);
-            if (from.empty()) {
-                tmoney += val;
-            } else {
-                tmoney += val - val * legacy_money::getConfig().pay_tax;
+        auto interval = std::chrono::seconds{getConfig().maintenance_interval};
+        scheduleMaintenance(on, done ? interval : std::chrono::seconds{1});
+    });
+}
+
+// Index creation, integrity check and statistics are not needed to serve the first calls, so they run once on the
+// worker after the mod is enabled instead of delaying server startup. Maintenance is scheduled from there too.
+void runDeferredTasks() {
+    if (!ledger) {
+        return;
+    }
+    worker->post([&on = *worker] {
+        auto& logger = LegacyMoney::getInstance().getSelf().getLogger();
+        auto  begin  = std::chrono::steady_clock::now();
+        auto  step   = [&](char const* name, auto&& task) {
+            try {
+                task();
+            } catch (std::exception const& e) {
+                logger.error("{} failed: {}", name, e.what());
             }
-            if (tmoney < 0) {
-                db->exec("rollback");
-                return false;
+            auto now = std::chrono::steady_clock::now();
+            auto ms  = std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count();
+            logger.debug("{} took {}ms", name, ms);
+            begin = now;
+        };
+        step("Index creation", [] { ledger->createIndexes(); });
+        step("Integrity check", [&] {
+            if (auto result = ledger->checkIntegrity(); result != "ok") {
+                logger.warn("Database integrity check reported problems:\n{}", result);
             }
-            {
-                set.bindNoCopy(2, to);
-                set.bind(1, tmoney);
-                set.exec();
-                set.reset();
-                set.clearBindings();
+        });
+        step("ANALYZE", [] { ledger->analyze(); });
+        step("Loading balance columns", [] {
+            for (auto const& currency : currencyIds()) {
+                ledger->summary(currency);
             }
+        });
+        if (getConfig().maintenance_interval > 0) {
+            step("Checking incremental vacuum", [&] {
+                if (!ledger->incrementalVacuum()) {
+                    logger.info("Freed space stays in economy.db until it is converted once with /money compact");
+                }
+            });
+            maintenance = std::make_unique<Maintenance>(
+                *ledger,
+                Maintenance::Options{
+                    getConfig().hist_retention,
+                    getConfig().hist_retention_rows,
+                    getConfig().trans_key_ttl,
+                    std::chrono::milliseconds{getConfig().maintenance_budget_ms},
+                    std::chrono::seconds{getConfig().optimize_interval}
+                }
+            );
+            scheduleMaintenance(on, std::chrono::seconds{getConfig().maintenance_interval});
         }
+    });
+}
 
-        {
-            SQLite::Statement addTrans{*db, "insert into mtrans (tFrom,tTo,Money,Note) values (?,?,?,?)"};
-            addTrans.bindNoCopy(1, from);
-            addTrans.bindNoCopy(2, to);
-            addTrans.bind(3, val);
-            addTrans.bindNoCopy(4, note);
-            addTrans.exec();
-            addTrans.reset();
-            addTrans.clearBindings();
+// Converts the database to incremental vacuum on the worker. The VACUUM rewrites the whole file and holds the ledger
+// until it is done, so it is only run when an operator asks for it. Returns false without a local ledger, or while the
+// mod is disabled.
+bool compactDatabase() {
+    if (!ledger || !worker) {
+        return false;
+    }
+    worker->post([] {
+        auto& logger = LegacyMoney::getInstance().getSelf().getLogger();
+        try {
+            if (ledger->incrementalVacuum()) {
+                logger.info("economy.db already gives freed space back");
+                return;
+            }
+            auto begin = std::chrono::steady_clock::now();
+            ledger->enableIncrementalVacuum();
+            logger.info(
+                "Compacted economy.db in {}ms",
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()
+            );
+        } catch (std::exception const& e) {
+            logger.error("Database error: {}\n", e.what());
         }
-        db->exec("commit");
+    });
+    return true;
+}
 
-        if (isRealTrans) {
-            CallAfterEvent(LLMoneyEvent::Trans, from, to, val);
+void closeDatabase() {
+    server.reset();
+    worker.reset();
+    maintenance.reset();
+    if (tracer) {
+        tracer->flush();
+        tracer.reset();
+    }
+}
+} // namespace legacy_money
+
+long long LLMoney_Get(std::string xuid) { return LLMoney_GetIn({}, std::move(xuid)); }
+
+long long LLMoney_GetIn(std::string currency, std::string xuid) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Get, xuid, {}, 0, {}, currency};
+    if (xuid.empty() || !legacy_money::knownCurrency(currency)) {
+        return call.done(-1);
+    }
+    try {
+        return call.done(store->get(currency, xuid));
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(-1);
+    }
+}
+
+bool LLMoney_Trans(std::string from, std::string to, long long val, std::string const& note) {
+    return LLMoney_TransIn({}, std::move(from), std::move(to), val, note);
+}
+
+// Listeners only know about one currency, so they are told about transfers in the default currency alone.
+bool LLMoney_TransIn(std::string currency, std::string from, std::string to, long long val, std::string const& note) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Trans, from, to, val, note, currency};
+    if (!legacy_money::knownCurrency(currency)) {
+        return call.done(false);
+    }
+    if (currency.empty() && !CallBeforeEvent(LLMoneyEvent::Trans, from, to, val)) {
+        return call.vetoed();
+    }
+    try {
+        if (!store->trans(currency, from, to, val, note)) {
+            return call.done(false);
         }
-        return true;
     } catch (std::exception const& e) {
-        db->exec("rollback");
         legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
-        return false;
+        return call.done(false);
+    }
+    if (currency.empty()) {
+        CallAfterEvent(LLMoneyEvent::Trans, from, to, val);
     }
+    return call.done(true);
 }
 
-bool LLMoney_Add(std::string xuid, long long money) {
-    if (xuid.empty() || !CallBeforeEvent(LLMoneyEvent::Add, {}, xuid, money)) {
-        return false;
+// A duplicate returns the remembered result without asking any listener; only the call that made the transfer is
+// reported to the after listeners.
+bool LLMoney_TransOnce(
+    std::string        key,
+    std::string        currency,
+    std::string        from,
+    std::string        to,
+    long long          val,
+    std::string const& note
+) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::TransOnce, from, to, val, note, currency, key};
+    if (key.empty() || !legacy_money::knownCurrency(currency)) {
+        return call.done(false);
+    }
+    legacy_money::KeyedResult rv;
+    try {
+        // A retry of a transfer that was already made returns its result without asking the listeners again, so
+        // one that would veto it now cannot make a completed transfer look like a failed one.
+        if (auto seen = store->keyResult(key)) {
+            return call.done(*seen);
+        }
+        if (currency.empty() && !CallBeforeEvent(LLMoneyEvent::Trans, from, to, val)) {
+            // The first call with this key may have completed meanwhile.
+            if (auto seen = store->keyResult(key)) {
+                return call.done(*seen);
+            }
+            return call.vetoed();
+        }
+        rv = store->transOnce(key, currency, from, to, val, note);
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(false);
     }
+    if (rv.ok && !rv.duplicate && currency.empty()) {
+        CallAfterEvent(LLMoneyEvent::Trans, from, to, val);
+    }
+    return call.done(rv.ok);
+}
 
-    isRealTrans = false;
-    bool res    = LLMoney_Trans({}, xuid, money, "add " + std::to_string(money));
-    if (res) CallAfterEvent(LLMoneyEvent::Add, {}, xuid, money);
-    return res;
+bool LLMoney_Exchange(
+    std::string        xuid,
+    std::string        fromCurrency,
+    long long          fromVal,
+    std::string        toCurrency,
+    long long          toVal,
+    std::string const& note
+) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Exchange, xuid, {}, fromVal, note, fromCurrency};
+    call.setExchange(toCurrency, toVal);
+    if (xuid.empty() || !legacy_money::knownCurrency(fromCurrency) || !legacy_money::knownCurrency(toCurrency)) {
+        return call.done(false);
+    }
+    if ((fromCurrency.empty() && !CallBeforeEvent(LLMoneyEvent::Reduce, {}, xuid, fromVal))
+        || (toCurrency.empty() && !CallBeforeEvent(LLMoneyEvent::Add, {}, xuid, toVal))) {
+        return call.vetoed();
+    }
+    try {
+        if (!store->exchange(xuid, fromCurrency, fromVal, toCurrency, toVal, note)) {
+            return call.done(false);
+        }
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(false);
+    }
+    if (fromCurrency.empty()) {
+        CallAfterEvent(LLMoneyEvent::Reduce, {}, xuid, fromVal);
+    }
+    if (toCurrency.empty()) {
+        CallAfterEvent(LLMoneyEvent::Add, {}, xuid, toVal);
+    }
+    return call.done(true);
 }
 
-bool LLMoney_Reduce(std::string xuid, long long money) {
-    if (xuid.empty() || !CallBeforeEvent(LLMoneyEvent::Reduce, {}, xuid, money)) {
-        return false;
+bool LLMoney_Add(std::string xuid, long long money) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Add, xuid, {}, money};
+    if (xuid.empty()) {
+        return call.done(false);
+    }
+    if (!CallBeforeEvent(LLMoneyEvent::Add, {}, xuid, money)) {
+        return call.vetoed();
     }
+    try {
+        if (!store->add({}, xuid, money)) {
+            return call.done(false);
+        }
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(false);
+    }
+    CallAfterEvent(LLMoneyEvent::Add, {}, xuid, money);
+    return call.done(true);
+}
 
-    isRealTrans = false;
-    bool res    = LLMoney_Trans(xuid, {}, money, "reduce " + std::to_string(money));
-    if (res) CallAfterEvent(LLMoneyEvent::Reduce, {}, xuid, money);
-    return res;
+bool LLMoney_Reduce(std::string xuid, long long money) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Reduce, xuid, {}, money};
+    if (xuid.empty()) {
+        return call.done(false);
+    }
+    if (!CallBeforeEvent(LLMoneyEvent::Reduce, {}, xuid, money)) {
+        return call.vetoed();
+    }
+    try {
+        if (!store->reduce({}, xuid, money)) {
+            return call.done(false);
+        }
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(false);
+    }
+    CallAfterEvent(LLMoneyEvent::Reduce, {}, xuid, money);
+    return call.done(true);
 }
 
 bool LLMoney_Set(std::string xuid, long long money) {
-    if (xuid.empty() || !CallBeforeEvent(LLMoneyEvent::Set, {}, xuid, money)) {
-        return false;
+    legacy_money::TraceCall call{legacy_money::TraceOp::Set, xuid, {}, money};
+    if (xuid.empty()) {
+        return call.done(false);
     }
-    long long   now = LLMoney_Get(xuid), diff;
-    std::string from, to;
-    if (money >= now) {
-        to   = xuid;
-        diff = money - now;
-    } else {
-        from = xuid;
-        diff = now - money;
+    if (!CallBeforeEvent(LLMoneyEvent::Set, {}, xuid, money)) {
+        return call.vetoed();
     }
-
-    isRealTrans = false;
-    bool res    = LLMoney_Trans(from, to, diff, "set to " + std::to_string(money));
-    if (res) CallAfterEvent(LLMoneyEvent::Set, {}, xuid, money);
-    return res;
+    try {
+        if (!store->set({}, xuid, money)) {
+            return call.done(false);
+        }
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(false);
+    }
+    CallAfterEvent(LLMoneyEvent::Set, {}, xuid, money);
+    return call.done(true);
 }
 
 std::vector<std::pair<std::string, long long>> LLMoney_Ranking(unsigned short num) {
+    return LLMoney_RankingIn({}, num);
+}
+
+std::vector<std::pair<std::string, long long>> LLMoney_RankingIn(std::string currency, unsigned short num) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Ranking, {}, {}, num, {}, currency};
+    if (!legacy_money::knownCurrency(currency)) {
+        return {};
+    }
     try {
-        SQLite::Statement                              get{*db, "select * from money ORDER BY money DESC LIMIT ?"};
-        std::vector<std::pair<std::string, long long>> mapTemp;
-        get.bind(1, num);
-        while (get.executeStep()) {
-            std::string xuid = get.getColumn(0).getString();
-            if (xuid.empty()) {
-                continue;
-            }
-            long long balance = get.getColumn(1).getInt64();
-            // std::cout << xuid << " " << balance << "\n";
-            mapTemp.push_back(std::pair<std::string, long long>(xuid, balance));
-        }
-        get.reset();
-        get.clearBindings();
-        return mapTemp;
+        return call.done(legacy_money::getRanking(currency, num, false)->rows);
     } catch (std::exception const& e) {
         legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
         return {};
     }
 }
 
-std::string LLMoney_GetHist(std::string xuid, int timediff) {
-    if (xuid.empty()) {
+std::string LLMoney_GetHist(std::string xuid, int timediff) { return LLMoney_GetHistIn({}, std::move(xuid), timediff); }
+
+std::string LLMoney_GetHistIn(std::string currency, std::string xuid, int timediff) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::GetHist, xuid, {}, timediff, {}, currency};
+    if (xuid.empty() || !legacy_money::knownCurrency(currency)) {
         return {};
     }
+    if (auto cached = legacy_money::getCachedHist(currency, xuid, timediff)) {
+        return call.done(std::move(*cached));
+    }
     try {
-        SQLite::Statement get{
-            *db,
-            "select tFrom,tTo,Money,datetime(Time,'unixepoch', 'localtime'),Note from mtrans where "
-            "strftime('%s','now')-time<? and (tFrom=? OR tTo=?) ORDER BY Time DESC"
-        };
         std::string rv;
-        get.bind(1, timediff);
-        get.bindNoCopy(2, xuid);
-        get.bindNoCopy(3, xuid);
-        while (get.executeStep()) {
-            std::string              fromXuid = get.getColumn(0).getString();
-            std::string              toXuid   = get.getColumn(1).getString();
-            std::string              fromName, toName = "System";
-            ll::service::PlayerInfo& info      = ll::service::PlayerInfo::getInstance();
-            auto                     fromEntry = fromXuid.empty() ? std::nullopt : info.fromXuid(fromXuid);
-            auto                     toEntry   = toXuid.empty() ? std::nullopt : info.fromXuid(toXuid);
-            if (fromEntry) {
-                fromName = fromEntry->name;
-            }
-            if (toEntry) {
-                toName = toEntry->name;
-            }
-            rv += fromName + " -> " + toName + " " + std::to_string((long long)get.getColumn(2).getInt64()) + " "
-                + get.getColumn(3).getText() + " (" + get.getColumn(4).getText() + ")\n";
+        for (auto const& entry : store->hist(currency, xuid, std::time(nullptr) - timediff)) {
+            rv += legacy_money::formatHist(entry);
         }
-        get.reset();
-        get.clearBindings();
-        return rv;
+        return call.done(std::move(rv));
     } catch (std::exception const& e) {
         legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
         return {};
@@ -270,11 +735,67 @@ std::string LLMoney_GetHist(std::string xuid, int timediff) {
 }
 
 void LLMoney_ClearHist(int difftime) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::ClearHist, {}, {}, difftime};
     try {
-        db->exec("DELETE FROM mtrans WHERE strftime('%s','now')-time>" + std::to_string(difftime));
+        store->clearHist(difftime);
+        legacy_money::clearCachedHist(difftime);
     } catch (std::exception&) {}
 }
 
+long long LLMoney_Sum() {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Sum};
+    try {
+        return call.done(store->summary({}).total);
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(-1);
+    }
+}
+
+LLMoneySummary LLMoney_Summary() {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Summary};
+    try {
+        auto summary = store->summary({});
+        call.done(summary.accounts);
+        return {(long long)summary.accounts, summary.total, summary.min, summary.max};
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        call.done(-1);
+        return {-1, 0, 0, 0};
+    }
+}
+
+long long LLMoney_CountAbove(long long threshold) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::CountAbove, {}, {}, threshold};
+    try {
+        return call.done((long long)store->countAbove({}, threshold));
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(-1);
+    }
+}
+
+double LLMoney_Gini() {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Gini};
+    try {
+        return call.done(store->gini({}));
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return call.done(-1.0);
+    }
+}
+
+std::vector<size_t> LLMoney_Histogram(long long min, long long max, unsigned short buckets) {
+    legacy_money::TraceCall call{legacy_money::TraceOp::Histogram, {}, {}, buckets};
+    call.setRange(min, max);
+    try {
+        return call.done(store->histogram({}, min, max, buckets));
+    } catch (std::exception const& e) {
+        legacy_money::LegacyMoney::getInstance().getSelf().getLogger().error("Database error: {}\n", e.what());
+        return {};
+    }
+}
+
 void ConvertData() {
     if (std::filesystem::exists(
             legacy_money::LegacyMoney::getInstance().getSelf().getModDir() / "LLMoney" / "money.db"
@@ -288,7 +809,7 @@ void ConvertData() {
                 SQLite::OPEN_CREATE | SQLite::OPEN_READWRITE
             );
             SQLite::Statement get{*db2, "select hex(XUID),Money from money"};
-            SQLite::Statement set{*db, "insert into money values (?,?)"};
+            SQLite::Statement set{ledger->database(), "insert into money (XUID,Money) values (?,?)"};
             while (get.executeStep()) {
                 std::string        blob = get.getColumn(0).getText();
                 unsigned long long value;
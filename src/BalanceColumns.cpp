@@ -0,0 +1,307 @@
+#include "BalanceColumns.h"
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <limits>
+#include <queue>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LEGACY_MONEY_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// MSVC compiles AVX2 intrinsics anywhere; GCC and Clang only in functions built for it.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET(features) __attribute__((target(features)))
+#else
+#define TARGET(features)
+#endif
+#endif
+
+namespace legacy_money {
+
+namespace {
+
+#ifdef LEGACY_MONEY_AVX2
+// The build targets plain x86-64, so the AVX2 kernels are compiled alongside the scalar ones and picked at run time.
+TARGET("xsave") bool detectAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // The CPU has to support AVX and the OS has to save the YMM registers.
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool const hasAvx2 = detectAvx2();
+
+// The vector halves of the kernels below. Each one covers whole blocks of four from i, and leaves i at the first
+// value it did not cover.
+
+TARGET("avx2") long long sumAvx2(long long const* data, size_t n, size_t& i) {
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256((__m256i const*)(data + i)));
+    }
+    alignas(32) long long lanes[4];
+    _mm256_store_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+TARGET("avx2") void minMaxAvx2(long long const* data, size_t n, size_t& i, long long& min, long long& max) {
+    if (n < 4) {
+        return;
+    }
+    __m256i lo = _mm256_loadu_si256((__m256i const*)data), hi = lo;
+    for (i = 4; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((__m256i const*)(data + i));
+        lo        = _mm256_blendv_epi8(lo, v, _mm256_cmpgt_epi64(lo, v));
+        hi        = _mm256_blendv_epi8(hi, v, _mm256_cmpgt_epi64(v, hi));
+    }
+    alignas(32) long long los[4], his[4];
+    _mm256_store_si256((__m256i*)los, lo);
+    _mm256_store_si256((__m256i*)his, hi);
+    min = *std::min_element(los, los + 4);
+    max = *std::max_element(his, his + 4);
+}
+
+TARGET("avx2") size_t countAboveAvx2(long long const* data, size_t n, size_t& i, long long threshold) {
+    size_t  count = 0;
+    __m256i limit = _mm256_set1_epi64x(threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m256i gt  = _mm256_cmpgt_epi64(_mm256_loadu_si256((__m256i const*)(data + i)), limit);
+        count      += (size_t)std::popcount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+    }
+    return count;
+}
+
+// Skips the blocks holding nothing above floor, so i ends at one that does or at the tail.
+TARGET("avx2") void skipNotAboveAvx2(long long const* data, size_t n, size_t& i, long long floor) {
+    __m256i limit = _mm256_set1_epi64x(floor);
+    for (; i + 4 <= n; i += 4) {
+        __m256i gt = _mm256_cmpgt_epi64(_mm256_loadu_si256((__m256i const*)(data + i)), limit);
+        if (!_mm256_testz_si256(gt, gt)) {
+            return;
+        }
+    }
+}
+
+// Only used when max - min < 2^52, so every offset converts to a double exactly through the exponent trick, as
+// AVX2 has no 64-bit integer conversion. The results match the scalar loop.
+TARGET("avx2") void histogramAvx2(
+    long long const*     data,
+    size_t               n,
+    size_t&              i,
+    long long            min,
+    long long            max,
+    double               scale,
+    std::vector<size_t>& rv
+) {
+    __m256i lo     = _mm256_set1_epi64x(min);
+    __m256i hi     = _mm256_set1_epi64x(max);
+    __m256i magic  = _mm256_set1_epi64x(0x4330000000000000); // 2^52 as a double
+    __m256d bias   = _mm256_set1_pd(4503599627370496.0);
+    __m256d factor = _mm256_set1_pd(scale);
+    __m128i last   = _mm_set1_epi32((int)rv.size() - 1);
+    // One set of counters per lane, so neighbouring balances in the same bucket do not wait on each other.
+    std::vector<size_t> counts(4 * rv.size());
+    size_t*             lanes[4] = {&counts[0], &counts[rv.size()], &counts[2 * rv.size()], &counts[3 * rv.size()]};
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((__m256i const*)(data + i));
+        v         = _mm256_blendv_epi8(v, lo, _mm256_cmpgt_epi64(lo, v));
+        v         = _mm256_blendv_epi8(v, hi, _mm256_cmpgt_epi64(v, hi));
+        __m256d offset = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_sub_epi64(v, lo), magic)), bias);
+        __m128i bucket = _mm_min_epi32(_mm256_cvttpd_epi32(_mm256_mul_pd(offset, factor)), last);
+        alignas(16) int buckets[4];
+        _mm_store_si128((__m128i*)buckets, bucket);
+        ++lanes[0][buckets[0]];
+        ++lanes[1][buckets[1]];
+        ++lanes[2][buckets[2]];
+        ++lanes[3][buckets[3]];
+    }
+    for (size_t bucket = 0; bucket < rv.size(); ++bucket) {
+        rv[bucket] += lanes[0][bucket] + lanes[1][bucket] + lanes[2][bucket] + lanes[3][bucket];
+    }
+}
+#endif
+
+long long sumKernel(long long const* data, size_t n) {
+    size_t    i     = 0;
+    long long total = 0;
+#ifdef LEGACY_MONEY_AVX2
+    if (hasAvx2) {
+        total = sumAvx2(data, n, i);
+    }
+#endif
+    for (; i < n; ++i) {
+        total += data[i];
+    }
+    return total;
+}
+
+void minMaxKernel(long long const* data, size_t n, long long& min, long long& max) {
+    size_t i = 0;
+    min      = std::numeric_limits<long long>::max();
+    max      = std::numeric_limits<long long>::min();
+#ifdef LEGACY_MONEY_AVX2
+    if (hasAvx2) {
+        minMaxAvx2(data, n, i, min, max);
+    }
+#endif
+    for (; i < n; ++i) {
+        min = std::min(min, data[i]);
+        max = std::max(max, data[i]);
+    }
+}
+
+size_t countAboveKernel(long long const* data, size_t n, long long threshold) {
+    size_t i     = 0;
+    size_t count = 0;
+#ifdef LEGACY_MONEY_AVX2
+    if (hasAvx2) {
+        count = countAboveAvx2(data, n, i, threshold);
+    }
+#endif
+    for (; i < n; ++i) {
+        count += data[i] > threshold;
+    }
+    return count;
+}
+
+// Indices of the k largest values, largest first. A min-heap holds the current top k, and values that cannot
+// enter it are skipped four at a time.
+std::vector<size_t> topKernel(long long const* data, size_t n, size_t k) {
+    k = std::min(k, n);
+    if (k == 0) {
+        return {};
+    }
+    auto worse = [data](size_t a, size_t b) { return data[a] > data[b] || (data[a] == data[b] && a < b); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(worse)> heap{worse};
+    size_t                                                            i = 0;
+    for (; i < k; ++i) {
+        heap.push(i);
+    }
+    auto offer = [&](size_t j) {
+        if (data[j] > data[heap.top()]) {
+            heap.pop();
+            heap.push(j);
+        }
+    };
+#ifdef LEGACY_MONEY_AVX2
+    while (hasAvx2) {
+        skipNotAboveAvx2(data, n, i, data[heap.top()]);
+        if (i + 4 > n) {
+            break;
+        }
+        for (size_t end = i + 4; i < end; ++i) {
+            offer(i);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        offer(i);
+    }
+    std::vector<size_t> rv(heap.size());
+    for (auto it = rv.rbegin(); it != rv.rend(); ++it) {
+        *it = heap.top();
+        heap.pop();
+    }
+    return rv;
+}
+
+} // namespace
+
+void BalanceColumns::clear() {
+    mBalances.clear();
+    mKeys.clear();
+    mIndex.clear();
+}
+
+void BalanceColumns::reserve(size_t accounts) {
+    mBalances.reserve(accounts);
+    mKeys.reserve(accounts);
+    mIndex.reserve(accounts);
+}
+
+void BalanceColumns::update(std::string const& xuid, long long money) {
+    if (auto it = mIndex.find(xuid); it != mIndex.end()) {
+        mBalances[it->second] = money;
+        return;
+    }
+    mIndex.emplace(xuid, mBalances.size());
+    mBalances.push_back(money);
+    mKeys.push_back(xuid);
+}
+
+BalanceSummary BalanceColumns::summary() const {
+    BalanceSummary rv;
+    rv.accounts = mBalances.size();
+    if (mBalances.empty()) {
+        return rv;
+    }
+    rv.total = sumKernel(mBalances.data(), mBalances.size());
+    minMaxKernel(mBalances.data(), mBalances.size(), rv.min, rv.max);
+    return rv;
+}
+
+double BalanceColumns::gini() const {
+    long long total = sumKernel(mBalances.data(), mBalances.size());
+    if (total <= 0) {
+        return 0.0;
+    }
+    // G = sum((2i - n - 1) * x_i) / (n * sum(x)) over the balances sorted ascending, i from 1.
+    std::vector<long long> sorted = mBalances;
+    std::sort(sorted.begin(), sorted.end());
+    double weighted = 0.0, n = (double)sorted.size();
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        weighted += (2.0 * (double)(i + 1) - n - 1.0) * (double)sorted[i];
+    }
+    return weighted / (n * (double)total);
+}
+
+size_t BalanceColumns::countAbove(long long threshold) const {
+    return countAboveKernel(mBalances.data(), mBalances.size(), threshold);
+}
+
+std::vector<size_t> BalanceColumns::histogram(long long min, long long max, size_t buckets) const {
+    std::vector<size_t> rv(buckets);
+    if (buckets == 0 || max < min) {
+        return rv;
+    }
+    // The offsets are taken in unsigned arithmetic, which cannot overflow for any range.
+    auto   range = (unsigned long long)max - (unsigned long long)min;
+    double scale = (double)buckets / ((double)range + 1.0);
+    size_t i     = 0;
+#ifdef LEGACY_MONEY_AVX2
+    if (hasAvx2 && range < (1ULL << 52)) {
+        histogramAvx2(mBalances.data(), mBalances.size(), i, min, max, scale, rv);
+    }
+#endif
+    for (; i < mBalances.size(); ++i) {
+        auto offset = (unsigned long long)std::clamp(mBalances[i], min, max) - (unsigned long long)min;
+        auto bucket = (size_t)((double)offset * scale);
+        ++rv[std::min(bucket, buckets - 1)];
+    }
+    return rv;
+}
+
+std::vector<std::pair<std::string, long long>> BalanceColumns::top(size_t k) const {
+    std::vector<std::pair<std::string, long long>> rv;
+    for (size_t index : topKernel(mBalances.data(), mBalances.size(), k)) {
+        rv.emplace_back(mKeys[index], mBalances[index]);
+    }
+    return rv;
+}
+
+} // namespace legacy_money
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Store.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace legacy_money {
+
+// A dense copy of the money table: balances in one contiguous array and the matching XUIDs in a parallel one,
+// so whole-economy aggregates are a linear scan instead of a SQL query. The kernels use AVX2 when the CPU
+// supports it and plain loops otherwise.
+class BalanceColumns {
+public:
+    void clear();
+
+    void reserve(size_t accounts);
+
+    // Inserts xuid or updates its balance.
+    void update(std::string const& xuid, long long money);
+
+    [[nodiscard]] size_t size() const { return mBalances.size(); }
+
+    [[nodiscard]] BalanceSummary summary() const;
+
+    // Sorts a copy of the balances, so it costs O(n log n) unlike the other aggregates.
+    [[nodiscard]] double gini() const;
+
+    // Number of accounts holding more than threshold.
+    [[nodiscard]] size_t countAbove(long long threshold) const;
+
+    // Accounts per bucket of equal width over [min, max]; balances outside the range are clamped to the ends.
+    [[nodiscard]] std::vector<size_t> histogram(long long min, long long max, size_t buckets) const;
+
+    // The k richest accounts, richest first.
+    [[nodiscard]] std::vector<std::pair<std::string, long long>> top(size_t k) const;
+
+private:
+    std::vector<long long>                  mBalances;
+    std::vector<std::string>                mKeys;
+    std::unordered_map<std::string, size_t> mIndex;
+};
+
+} // namespace legacy_money
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace legacy_money::codec {
+
+inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+inline void putInt(std::string& out, long long value) {
+    putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+inline void putString(std::string& out, std::string_view value) {
+    putVarint(out, value.size());
+    out.append(value);
+}
+
+// Decodes from the front of a buffer. Any read past the end marks the reader as failed and yields zero values.
+class Reader {
+public:
+    explicit Reader(std::string_view data) : mData(data) {}
+
+    [[nodiscard]] bool ok() const { return mOk; }
+
+    [[nodiscard]] bool empty() const { return mData.empty(); }
+
+    [[nodiscard]] std::string_view remaining() const { return mData; }
+
+    uint8_t getByte() {
+        if (mData.empty()) {
+            mOk = false;
+            return 0;
+        }
+        auto value = (uint8_t)mData.front();
+        mData.remove_prefix(1);
+        return value;
+    }
+
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte  = getByte();
+            value        |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        mOk = false;
+        return 0;
+    }
+
+    long long getInt() {
+        uint64_t value = getVarint();
+        return (long long)((value >> 1) ^ (~(value & 1) + 1));
+    }
+
+    std::string getString() {
+        uint64_t size = getVarint();
+        if (size > mData.size()) {
+            mOk   = false;
+            mData = {};
+            return {};
+        }
+        std::string value{mData.substr(0, size)};
+        mData.remove_prefix(size);
+        return value;
+    }
+
+private:
+    std::string_view mData;
+    bool             mOk = true;
+};
+
+} // namespace legacy_money::codec
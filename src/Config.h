@@ -1,14 +1,37 @@
+#include <map>
 #include <string>
 
 namespace legacy_money {
-struct MoneyConfig {
-    int         version         = 2;
+struct CurrencyConfig {
     int         def_money       = 0;
     float       pay_tax         = 0.0;
-    bool        enable_commands = true;
     std::string currency_symbol = "$";
 };
 
+struct MoneyConfig {
+    int         version               = 2;
+    int         def_money             = 0;
+    float       pay_tax               = 0.0;
+    bool        enable_commands       = true;
+    std::string currency_symbol       = "$";
+    int         hist_cache_size       = 64;                // Recent records cached per online player, 0 to disable
+    int         hist_cache_window     = 24 * 60 * 60;      // Seconds of history loaded into the cache on join
+    std::string trace_file            = "";                // Trace LLMoney_* calls to a file per start named after this
+    std::string ledger_mode           = "local";           // "local", "server" (also serve ledger_address) or "client"
+    std::string ledger_address        = "127.0.0.1:25590"; // Loopback address of the shared ledger
+    int         remote_cache_ms       = 500;               // How long a client may reuse a balance read from the server
+    int         remote_timeout_ms     = 5000;              // How long a client waits for the server, 0 for no limit
+    int         ranking_cache_ms      = 0;                 // How long a ranking may be reused after it changed
+    int         hist_retention        = 0;                 // Seconds of history to keep, 0 to keep all of it
+    int         hist_retention_rows   = 0;                 // History records to keep, 0 for no limit
+    int         maintenance_interval  = 60;                // Seconds between maintenance runs, 0 to disable them
+    int         maintenance_budget_ms = 50;                // How long one maintenance run may work
+    int         optimize_interval     = 6 * 60 * 60;       // Seconds between query planner statistics updates
+    int         trans_key_ttl         = 24 * 60 * 60;      // Seconds a LLMoney_TransOnce key is remembered
+    // Further currencies by id. def_money, pay_tax and currency_symbol above belong to the default currency.
+    std::map<std::string, CurrencyConfig> currencies = {};
+};
+
 bool         loadConfig();
 MoneyConfig& getConfig();
 } // namespace legacy_money
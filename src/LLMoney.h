@@ -12,6 +12,14 @@
 
 enum LLMoneyEvent { Set, Add, Reduce, Trans };
 
+// Accounts is -1 when the summary could not be collected.
+struct LLMoneySummary {
+    long long accounts;
+    long long total;
+    long long min;
+    long long max;
+};
+
 typedef bool (*LLMoneyCallback)(LLMoneyEvent type, std::string from, std::string to, long long value);
 
 #ifdef __cplusplus
@@ -26,9 +34,44 @@ LLMONEY_API bool      LLMoney_Reduce(std::string xuid, long long money);
 LLMONEY_API std::string LLMoney_GetHist(std::string xuid, int timediff = 24 * 60 * 60);
 LLMONEY_API void        LLMoney_ClearHist(int difftime = 0);
 
+// Per-currency variants. The empty currency id is the default currency used by the calls above; unknown ids fail.
+LLMONEY_API long long LLMoney_GetIn(std::string currency, std::string xuid);
+// With ledger_mode "client", a transfer that fails because the shared ledger stopped answering may still have been
+// made. Use LLMoney_TransOnce when a transfer has to be retried.
+LLMONEY_API bool
+LLMoney_TransIn(std::string currency, std::string from, std::string to, long long val, std::string const& note = "");
+LLMONEY_API std::string LLMoney_GetHistIn(std::string currency, std::string xuid, int timediff = 24 * 60 * 60);
+// Makes the transfer once per key; repeating a call with the same key returns the first result without transferring
+// again, so callers can retry safely. Keys are remembered for trans_key_ttl seconds. An empty key fails.
+LLMONEY_API bool LLMoney_TransOnce(
+    std::string        key,
+    std::string        currency,
+    std::string        from,
+    std::string        to,
+    long long          val,
+    std::string const& note = ""
+);
+// Takes fromVal of fromCurrency from xuid and gives toVal of toCurrency in one transaction, without tax.
+LLMONEY_API bool LLMoney_Exchange(
+    std::string        xuid,
+    std::string        fromCurrency,
+    long long          fromVal,
+    std::string        toCurrency,
+    long long          toVal,
+    std::string const& note = ""
+);
+
+LLMONEY_API long long      LLMoney_Sum();
+LLMONEY_API LLMoneySummary LLMoney_Summary();
+LLMONEY_API long long      LLMoney_CountAbove(long long threshold);
+LLMONEY_API double         LLMoney_Gini();
+
 LLMONEY_API void LLMoney_ListenBeforeEvent(LLMoneyCallback callback);
 LLMONEY_API void LLMoney_ListenAfterEvent(LLMoneyCallback callback);
 #ifdef __cplusplus
 }
 #endif
 LLMONEY_API std::vector<std::pair<std::string, long long>> LLMoney_Ranking(unsigned short num = 5);
+LLMONEY_API std::vector<std::pair<std::string, long long>>
+            LLMoney_RankingIn(std::string currency, unsigned short num = 5);
+LLMONEY_API std::vector<size_t> LLMoney_Histogram(long long min, long long max, unsigned short buckets = 10);
@@ -0,0 +1,679 @@
+#include "Ledger.h"
+#include <algorithm>
+#include <ctime>
+#include <limits>
+#include <string_view>
+#include <thread>
+
+namespace legacy_money {
+
+// Rows read per lock hold when loading the columns of a currency.
+static constexpr int columnsChunk = 8192;
+
+// More than one, so keys expire faster than new ones arrive.
+static constexpr int keysExpiredPerKey = 4;
+
+static constexpr char const* createMoney = "CREATE TABLE IF NOT EXISTS money ( \
+			XUID     TEXT NOT NULL, \
+			Currency TEXT NOT NULL \
+			DEFAULT(''), \
+			Money    NUMERIC NOT NULL, \
+			PRIMARY KEY (XUID, Currency) \
+		) \
+			WITHOUT ROWID; ";
+
+Ledger::Ledger(std::filesystem::path const& path) : mDb(path, SQLite::OPEN_CREATE | SQLite::OPEN_READWRITE) {
+    // Only takes effect on a new database, existing ones are converted by enableIncrementalVacuum() on request.
+    mDb.exec("PRAGMA auto_vacuum = INCREMENTAL");
+    mDb.exec("PRAGMA journal_mode = WAL");
+    mDb.exec("PRAGMA synchronous = NORMAL");
+    mDb.exec(createMoney);
+    mDb.exec("CREATE TABLE IF NOT EXISTS mtrans ( \
+			tFrom    TEXT  NOT NULL, \
+			tTo      TEXT  NOT NULL, \
+			Money    NUMERIC  NOT NULL, \
+			Time     NUMERIC NOT NULL \
+			DEFAULT(strftime('%s', 'now')), \
+			Note     TEXT, \
+			Currency TEXT NOT NULL \
+			DEFAULT('') \
+		);");
+    mDb.exec("CREATE TABLE IF NOT EXISTS mkeys ( \
+			Key    TEXT NOT NULL PRIMARY KEY, \
+			Result INTEGER NOT NULL, \
+			Time   NUMERIC NOT NULL \
+		) \
+			WITHOUT ROWID;");
+    // Created right away rather than with the deferred indexes, since transOnce() prunes by Time on every new key.
+    mDb.exec("CREATE INDEX IF NOT EXISTS idx_keys ON mkeys (Time);");
+    migrate();
+}
+
+void Ledger::migrate() {
+    auto hasColumn = [&](char const* table, std::string_view column) {
+        SQLite::Statement info{mDb, std::string{"PRAGMA table_info("} + table + ")"};
+        while (info.executeStep()) {
+            if (info.getColumn(1).getString() == column) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (!hasColumn("mtrans", "Currency")) {
+        mDb.exec("ALTER TABLE mtrans ADD COLUMN Currency TEXT NOT NULL DEFAULT('')");
+    }
+    if (!hasColumn("money", "Currency")) {
+        mDb.exec("begin");
+        try {
+            mDb.exec("ALTER TABLE money RENAME TO money_old");
+            mDb.exec(createMoney);
+            mDb.exec("INSERT INTO money (XUID, Money) SELECT XUID, Money FROM money_old");
+            mDb.exec("DROP TABLE money_old");
+            mDb.exec("commit");
+        } catch (...) {
+            mDb.tryExec("rollback");
+            throw;
+        }
+    }
+}
+
+SQLite::Statement& Ledger::statement(std::string const& sql) {
+    auto& stmt = mStatements.try_emplace(sql, mDb, sql).first->second;
+    // A statement that threw on its last use is still bound and mid-step.
+    stmt.tryReset();
+    stmt.clearBindings();
+    return stmt;
+}
+
+Ledger::Options const& Ledger::options(std::string const& currency) const {
+    static Options const none;
+    auto                 it = mOptions.find(currency);
+    return it == mOptions.end() ? none : it->second;
+}
+
+void Ledger::createIndexes() {
+    std::lock_guard lock{mMutex};
+    mDb.exec("CREATE INDEX IF NOT EXISTS idx ON mtrans ( \
+			Time COLLATE BINARY COLLATE BINARY DESC \
+		); ");
+}
+
+std::string Ledger::checkIntegrity() {
+    std::lock_guard   lock{mMutex};
+    SQLite::Statement check{mDb, "PRAGMA quick_check"};
+    std::string       rv;
+    while (check.executeStep()) {
+        if (!rv.empty()) {
+            rv += "\n";
+        }
+        rv += check.getColumn(0).getString();
+    }
+    return rv;
+}
+
+void Ledger::analyze() {
+    std::lock_guard lock{mMutex};
+    mDb.exec("ANALYZE");
+}
+
+void Ledger::optimize() {
+    std::lock_guard lock{mMutex};
+    mDb.exec("PRAGMA optimize");
+}
+
+Ledger::HistTrim Ledger::trimHist(long long before, int limit) {
+    std::lock_guard lock{mMutex};
+    HistTrim        rv;
+    auto&           oldest = statement(
+        "select count(*),max(Time) from (select Time from mtrans where Time<? ORDER BY Time LIMIT ?)"
+    );
+    oldest.bind(1, before);
+    oldest.bind(2, limit);
+    if (oldest.executeStep()) {
+        rv.deleted = (size_t)oldest.getColumn(0).getInt64();
+        rv.newest  = oldest.getColumn(1).getInt64();
+    }
+    oldest.reset();
+    oldest.clearBindings();
+    if (rv.deleted) {
+        auto& trim = statement(
+            "DELETE FROM mtrans WHERE rowid IN (select rowid from mtrans where Time<? ORDER BY Time LIMIT ?)"
+        );
+        trim.bind(1, before);
+        trim.bind(2, limit);
+        trim.exec();
+        trim.reset();
+        trim.clearBindings();
+    }
+    return rv;
+}
+
+size_t Ledger::expireKeys(long long before, int limit) {
+    std::lock_guard lock{mMutex};
+    auto&           expire = statement(
+        "DELETE FROM mkeys WHERE Key IN (select Key from mkeys where Time<? ORDER BY Time LIMIT ?)"
+    );
+    expire.bind(1, before);
+    expire.bind(2, limit);
+    auto rv = (size_t)expire.exec();
+    expire.reset();
+    expire.clearBindings();
+    return rv;
+}
+
+Ledger::HistTrim Ledger::trimHistRows(long long keep, int limit) {
+    std::lock_guard lock{mMutex};
+    // Records are only ever deleted oldest first, so rowids stay close to contiguous and the newest keep of them
+    // hold at most keep records. This needs no count(*) over the table.
+    auto&     newest = statement("select max(rowid) from mtrans");
+    long long cutoff = newest.executeStep() ? newest.getColumn(0).getInt64() - keep : 0;
+    newest.reset();
+    HistTrim rv;
+    if (cutoff <= 0) {
+        return rv;
+    }
+    auto& oldest = statement(
+        "select count(*),max(Time) from (select Time from mtrans where rowid<=? ORDER BY rowid LIMIT ?)"
+    );
+    oldest.bind(1, cutoff);
+    oldest.bind(2, limit);
+    if (oldest.executeStep()) {
+        rv.deleted = (size_t)oldest.getColumn(0).getInt64();
+        rv.newest  = oldest.getColumn(1).getInt64();
+    }
+    oldest.reset();
+    oldest.clearBindings();
+    if (rv.deleted) {
+        auto& trim = statement(
+            "DELETE FROM mtrans WHERE rowid IN (select rowid from mtrans where rowid<=? ORDER BY rowid LIMIT ?)"
+        );
+        trim.bind(1, cutoff);
+        trim.bind(2, limit);
+        trim.exec();
+        trim.reset();
+        trim.clearBindings();
+    }
+    return rv;
+}
+
+long long Ledger::pragma(std::string const& name, int column) {
+    SQLite::Statement get{mDb, "PRAGMA " + name};
+    return get.executeStep() ? get.getColumn(column).getInt64() : 0;
+}
+
+bool Ledger::incrementalVacuum() {
+    std::lock_guard lock{mMutex};
+    return pragma("auto_vacuum") == 2;
+}
+
+void Ledger::enableIncrementalVacuum() {
+    std::lock_guard lock{mMutex};
+    mDb.exec("PRAGMA auto_vacuum = INCREMENTAL");
+    mDb.exec("VACUUM");
+}
+
+long long Ledger::freeBytes() {
+    std::lock_guard lock{mMutex};
+    return pragma("freelist_count") * pragma("page_size");
+}
+
+long long Ledger::vacuum(int pages) {
+    std::lock_guard lock{mMutex};
+    long long       before = pragma("page_count");
+    mDb.exec("PRAGMA incremental_vacuum(" + std::to_string(pages) + ")");
+    return (before - pragma("page_count")) * pragma("page_size");
+}
+
+long long Ledger::checkpoint() {
+    std::lock_guard lock{mMutex};
+    // A truncating checkpoint reports the emptied log, so the size is taken by a passive one that does the copying.
+    long long pages = pragma("wal_checkpoint(PASSIVE)", 1);
+    mDb.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+    return std::max(pages, 0LL) * pragma("page_size");
+}
+
+void Ledger::prefetch(std::string const& xuid) {
+    std::lock_guard lock{mMutex};
+    auto&           balances = mBalances[xuid];
+    auto&           stored   = statement("select Currency,Money from money where XUID=?");
+    stored.bindNoCopy(1, xuid);
+    while (stored.executeStep()) {
+        balances[stored.getColumn(0).getString()] = stored.getColumn(1).getInt64();
+    }
+    stored.reset();
+    stored.clearBindings();
+    // Created here rather than by the first transfer, whose savepoint may be rolled back.
+    get({}, xuid);
+    for (auto const& [currency, options] : mOptions) {
+        get(currency, xuid);
+    }
+}
+
+void Ledger::release(std::string const& xuid) {
+    std::lock_guard lock{mMutex};
+    mBalances.erase(xuid);
+}
+
+long long Ledger::get(std::string const& currency, std::string const& xuid) {
+    std::lock_guard lock{mMutex};
+    auto            pinned = mBalances.find(xuid);
+    if (pinned != mBalances.end()) {
+        if (auto it = pinned->second.find(currency); it != pinned->second.end()) {
+            return it->second;
+        }
+    }
+    bool      created = false;
+    long long money   = load(currency, xuid, created);
+    if (pinned != mBalances.end()) {
+        pinned->second[currency] = money;
+    }
+    if (created) {
+        updateColumns(currency, xuid, money);
+        changed(currency, xuid, money);
+    }
+    return money;
+}
+
+long long Ledger::balance(std::string const& currency, std::string const& xuid) {
+    if (auto pinned = mBalances.find(xuid); pinned != mBalances.end()) {
+        if (auto it = pinned->second.find(currency); it != pinned->second.end()) {
+            return it->second;
+        }
+    }
+    bool created = false;
+    return load(currency, xuid, created);
+}
+
+long long Ledger::load(std::string const& currency, std::string const& xuid, bool& created) {
+    auto& get = statement("select Money from money where XUID=? and Currency=?");
+    get.bindNoCopy(1, xuid);
+    get.bindNoCopy(2, currency);
+    long long rv = options(currency).defMoney;
+    bool      fg = false;
+    while (get.executeStep()) {
+        rv = (long long)get.getColumn(0).getInt64();
+        fg = true;
+    }
+    get.reset();
+    get.clearBindings();
+    if (!fg) {
+        auto& set = statement("insert into money (XUID,Currency,Money) values (?,?,?)");
+        set.bindNoCopy(1, xuid);
+        set.bindNoCopy(2, currency);
+        set.bind(3, rv);
+        set.exec();
+        set.reset();
+        set.clearBindings();
+        created = true;
+    }
+    return rv;
+}
+
+BalanceColumns& Ledger::columns(std::string const& currency, std::unique_lock<std::recursive_mutex>& lock) {
+    while (true) {
+        if (auto it = mColumns.find(currency); it != mColumns.end()) {
+            return it->second;
+        }
+        // Another caller may have loaded part of the table already; carry on from where it stopped.
+        auto [it, inserted] = mLoading.try_emplace(currency);
+        auto& loading       = it->second;
+        int   rows          = 0;
+        try {
+            if (inserted) {
+                // Every account has a row in each configured currency. Sized up front, the columns never rehash
+                // the whole index in the middle of a chunk.
+                auto& count = statement("select count(*) from money");
+                if (count.executeStep()) {
+                    auto currencies = mOptions.size() + !mOptions.contains({});
+                    loading.columns.reserve((size_t)count.getColumn(0).getInt64() / currencies);
+                }
+                count.reset();
+            }
+            auto& get = statement("select XUID,Money from money where Currency=? and XUID>? ORDER BY XUID LIMIT ?");
+            get.bindNoCopy(1, currency);
+            get.bind(2, loading.after);
+            get.bind(3, columnsChunk);
+            while (get.executeStep()) {
+                loading.after = get.getColumn(0).getString();
+                if (!loading.after.empty()) {
+                    loading.columns.update(loading.after, get.getColumn(1).getInt64());
+                }
+                ++rows;
+            }
+            get.reset();
+            get.clearBindings();
+        } catch (...) {
+            mLoading.erase(currency);
+            throw;
+        }
+        if (rows < columnsChunk) {
+            auto& rv = mColumns[currency] = std::move(loading.columns);
+            mLoading.erase(currency);
+            return rv;
+        }
+        // Lets transfers through between chunks. They keep the loaded part up to date, and the rest is read
+        // with their changes. Inside a batch the lock stays held, since it is recursive.
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+}
+
+void Ledger::updateColumns(std::string const& currency, std::string const& xuid, long long money) {
+    if (auto it = mColumns.find(currency); it != mColumns.end()) {
+        it->second.update(xuid, money);
+    } else if (auto loading = mLoading.find(currency); loading != mLoading.end() && xuid <= loading->second.after) {
+        loading->second.columns.update(xuid, money);
+    }
+}
+
+bool Ledger::write(HistEntry const& entry, long long& fromMoney, long long& toMoney) {
+    auto& set = statement("update money set Money=? where XUID=? and Currency=?");
+    if (!entry.from.empty()) {
+        fromMoney = balance(entry.currency, entry.from);
+        if (fromMoney < entry.money) {
+            return false;
+        }
+        fromMoney -= entry.money;
+        set.bind(1, fromMoney);
+        set.bindNoCopy(2, entry.from);
+        set.bindNoCopy(3, entry.currency);
+        set.exec();
+        set.reset();
+        set.clearBindings();
+    }
+    if (!entry.to.empty()) {
+        toMoney = balance(entry.currency, entry.to);
+        if (entry.from.empty()) {
+            toMoney += entry.money;
+        } else {
+            toMoney += entry.money - entry.money * options(entry.currency).payTax;
+        }
+        if (toMoney < 0) {
+            return false;
+        }
+        set.bind(1, toMoney);
+        set.bindNoCopy(2, entry.to);
+        set.bindNoCopy(3, entry.currency);
+        set.exec();
+        set.reset();
+        set.clearBindings();
+    }
+    auto& addTrans = statement("insert into mtrans (tFrom,tTo,Money,Time,Note,Currency) values (?,?,?,?,?,?)");
+    addTrans.bindNoCopy(1, entry.from);
+    addTrans.bindNoCopy(2, entry.to);
+    addTrans.bind(3, entry.money);
+    addTrans.bind(4, entry.time);
+    addTrans.bindNoCopy(5, entry.note);
+    addTrans.bindNoCopy(6, entry.currency);
+    addTrans.exec();
+    addTrans.reset();
+    addTrans.clearBindings();
+    return true;
+}
+
+void Ledger::publish(HistEntry const& entry, long long fromMoney, long long toMoney) {
+    for (auto [xuid, money] : {std::pair{&entry.from, fromMoney}, std::pair{&entry.to, toMoney}}) {
+        if (xuid->empty()) {
+            continue;
+        }
+        if (auto it = mBalances.find(*xuid); it != mBalances.end()) {
+            it->second[entry.currency] = money;
+        }
+        updateColumns(entry.currency, *xuid, money);
+        changed(entry.currency, *xuid, money);
+    }
+    if (mBatched) {
+        mBatched->push_back(entry);
+    } else if (mTransListener) {
+        mTransListener(entry);
+    }
+}
+
+void Ledger::changed(std::string const& currency, std::string const& xuid, long long money) {
+    uint64_t epoch = ++mEpoch;
+    if (mBalanceListener) {
+        mBalanceListener(currency, xuid, money, epoch);
+    }
+}
+
+bool Ledger::trans(
+    std::string const& currency,
+    std::string const& from,
+    std::string const& to,
+    long long          val,
+    std::string const& note
+) {
+    if (val < 0 || from == to) {
+        return false;
+    }
+    std::lock_guard lock{mMutex};
+    HistEntry       entry{from, to, val, std::time(nullptr), note, currency};
+    long long       fmoney = 0, tmoney = 0;
+    try {
+        // A savepoint instead of begin, so transfers can be grouped into one commit by batch().
+        mDb.exec("savepoint trans");
+        if (!write(entry, fmoney, tmoney)) {
+            mDb.exec("rollback to trans; release trans");
+            return false;
+        }
+        mDb.exec("release trans");
+    } catch (...) {
+        mDb.tryExec("rollback to trans; release trans");
+        throw;
+    }
+    publish(entry, fmoney, tmoney);
+    return true;
+}
+
+// The key is written in the same savepoint as the transfer, so it is committed or rolled back together with it.
+// Refused transfers are remembered too: a retry must not succeed just because the balance has grown since.
+// Expired keys are ignored, and every new key forgets a few of them, so the table stays bounded without Maintenance.
+KeyedResult Ledger::transOnce(
+    std::string const& key,
+    std::string const& currency,
+    std::string const& from,
+    std::string const& to,
+    long long          val,
+    std::string const& note
+) {
+    if (key.empty()) {
+        return {};
+    }
+    std::lock_guard lock{mMutex};
+    if (auto seen = keyResult(key)) {
+        return {*seen, true};
+    }
+    long long now = std::time(nullptr);
+    HistEntry entry{from, to, val, now, note, currency};
+    long long fmoney = 0, tmoney = 0;
+    bool      ok     = val >= 0 && from != to;
+    try {
+        mDb.exec("savepoint once");
+        if (ok && !write(entry, fmoney, tmoney)) {
+            mDb.exec("rollback to once");
+            ok = false;
+        }
+        // Replaces an expired row of the same key.
+        auto& remember = statement("insert or replace into mkeys (Key,Result,Time) values (?,?,?)");
+        remember.bindNoCopy(1, key);
+        remember.bind(2, (int)ok);
+        remember.bind(3, entry.time);
+        remember.exec();
+        remember.reset();
+        remember.clearBindings();
+        if (mKeyTtl > 0) {
+            expireKeys(now - mKeyTtl, keysExpiredPerKey);
+        }
+        mDb.exec("release once");
+    } catch (...) {
+        mDb.tryExec("rollback to once; release once");
+        throw;
+    }
+    if (ok) {
+        publish(entry, fmoney, tmoney);
+    }
+    return {ok, false};
+}
+
+std::optional<bool> Ledger::keyResult(std::string const& key) {
+    std::lock_guard lock{mMutex};
+    auto&           seen = statement("select Result from mkeys where Key=? and Time>=?");
+    seen.bindNoCopy(1, key);
+    seen.bind(2, mKeyTtl > 0 ? std::time(nullptr) - mKeyTtl : std::numeric_limits<long long>::min());
+    std::optional<bool> rv;
+    if (seen.executeStep()) {
+        rv = seen.getColumn(0).getInt64() != 0;
+    }
+    seen.reset();
+    seen.clearBindings();
+    return rv;
+}
+
+bool Ledger::exchange(
+    std::string const& xuid,
+    std::string const& fromCurrency,
+    long long          fromVal,
+    std::string const& toCurrency,
+    long long          toVal,
+    std::string const& note
+) {
+    if (xuid.empty() || fromVal < 0 || toVal < 0 || fromCurrency == toCurrency) {
+        return false;
+    }
+    std::lock_guard lock{mMutex};
+    long long       now = std::time(nullptr);
+    HistEntry       sold{xuid, {}, fromVal, now, note, fromCurrency};
+    HistEntry       bought{{}, xuid, toVal, now, note, toCurrency};
+    long long       soldMoney = 0, boughtMoney = 0, unused = 0;
+    try {
+        mDb.exec("savepoint exchange");
+        if (!write(sold, soldMoney, unused) || !write(bought, unused, boughtMoney)) {
+            mDb.exec("rollback to exchange; release exchange");
+            return false;
+        }
+        mDb.exec("release exchange");
+    } catch (...) {
+        mDb.tryExec("rollback to exchange; release exchange");
+        throw;
+    }
+    publish(sold, soldMoney, 0);
+    publish(bought, 0, boughtMoney);
+    return true;
+}
+
+void Ledger::batch(std::function<void()> const& task) {
+    std::lock_guard lock{mMutex};
+    mDb.exec("begin");
+    // The transfer listener only hears about the batch once it is committed.
+    mBatched.emplace();
+    try {
+        task();
+        mDb.exec("commit");
+    } catch (...) {
+        mBatched.reset();
+        mDb.tryExec("rollback");
+        // Balances cached by transfers of this batch were never committed. Players stay pinned.
+        for (auto& [xuid, balances] : mBalances) {
+            balances.clear();
+        }
+        mColumns.clear();
+        mLoading.clear();
+        ++mEpoch;
+        throw;
+    }
+    auto committed = std::move(*mBatched);
+    mBatched.reset();
+    if (mTransListener) {
+        for (auto const& entry : committed) {
+            mTransListener(entry);
+        }
+    }
+}
+
+bool Ledger::add(std::string const& currency, std::string const& xuid, long long money) {
+    return trans(currency, {}, xuid, money, "add " + std::to_string(money));
+}
+
+bool Ledger::reduce(std::string const& currency, std::string const& xuid, long long money) {
+    return trans(currency, xuid, {}, money, "reduce " + std::to_string(money));
+}
+
+bool Ledger::set(std::string const& currency, std::string const& xuid, long long money) {
+    std::lock_guard lock{mMutex};
+    long long       now = get(currency, xuid), diff;
+    std::string     from, to;
+    if (money >= now) {
+        to   = xuid;
+        diff = money - now;
+    } else {
+        from = xuid;
+        diff = now - money;
+    }
+    return trans(currency, from, to, diff, "set to " + std::to_string(money));
+}
+
+std::vector<std::pair<std::string, long long>> Ledger::ranking(std::string const& currency, unsigned short num) {
+    std::unique_lock lock{mMutex};
+    return columns(currency, lock).top(num);
+}
+
+BalanceSummary Ledger::summary(std::string const& currency) {
+    std::unique_lock lock{mMutex};
+    return columns(currency, lock).summary();
+}
+
+double Ledger::gini(std::string const& currency) {
+    std::unique_lock lock{mMutex};
+    return columns(currency, lock).gini();
+}
+
+size_t Ledger::countAbove(std::string const& currency, long long threshold) {
+    std::unique_lock lock{mMutex};
+    return columns(currency, lock).countAbove(threshold);
+}
+
+std::vector<size_t>
+Ledger::histogram(std::string const& currency, long long min, long long max, unsigned short buckets) {
+    std::unique_lock lock{mMutex};
+    return columns(currency, lock).histogram(min, max, buckets);
+}
+
+std::vector<HistEntry>
+Ledger::hist(std::string const& currency, std::string const& xuid, long long after, int limit) {
+    std::lock_guard lock{mMutex};
+    auto&           get = statement(
+        "select tFrom,tTo,Money,Time,Note from mtrans where Time>? and Currency=? and (tFrom=? OR tTo=?) "
+        "ORDER BY Time DESC LIMIT ?"
+    );
+    std::vector<HistEntry> rv;
+    get.bind(1, after);
+    get.bindNoCopy(2, currency);
+    get.bindNoCopy(3, xuid);
+    get.bindNoCopy(4, xuid);
+    get.bind(5, limit);
+    while (get.executeStep()) {
+        rv.push_back(
+            {get.getColumn(0).getString(),
+             get.getColumn(1).getString(),
+             (long long)get.getColumn(2).getInt64(),
+             (long long)get.getColumn(3).getInt64(),
+             get.getColumn(4).getString(),
+             currency}
+        );
+    }
+    get.reset();
+    get.clearBindings();
+    return rv;
+}
+
+void Ledger::clearHist(int difftime) {
+    std::lock_guard lock{mMutex};
+    auto&           clear = statement("DELETE FROM mtrans WHERE strftime('%s','now')-time>?");
+    clear.bind(1, difftime);
+    clear.exec();
+    clear.reset();
+    clear.clearBindings();
+}
+
+} // namespace legacy_money
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "BalanceColumns.h"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include "Store.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace legacy_money {
+
+// The SQLite-backed economy store shared by the mod and the standalone tools. It has no dependency on the game
+// server: events, name resolution and logging are left to the caller, and database errors are thrown.
+// All members may be called from any thread; calls are serialized on one connection.
+class Ledger : public Store {
+public:
+    struct Options {
+        long long defMoney = 0;
+        float     payTax   = 0.0;
+    };
+
+    using TransListener = std::function<void(HistEntry const&)>;
+
+    using BalanceListener =
+        std::function<void(std::string const& currency, std::string const& xuid, long long money, uint64_t epoch)>;
+
+    // Only creates what the exported calls need to work. Indexes and checks are left to the deferred tasks below.
+    explicit Ledger(std::filesystem::path const& path);
+
+    [[nodiscard]] SQLite::Database& database() { return mDb; }
+
+    // Holds off every other thread, e.g. to keep a caller-side cache consistent with the ledger.
+    [[nodiscard]] std::unique_lock<std::recursive_mutex> lock() { return std::unique_lock{mMutex}; }
+
+    void createIndexes();
+
+    // Returns "ok", or the problems reported by PRAGMA quick_check.
+    std::string checkIntegrity();
+
+    void analyze();
+
+    // PRAGMA optimize, which refreshes the statistics of tables that changed enough to need it.
+    void optimize();
+
+    struct HistTrim {
+        size_t    deleted = 0;
+        long long newest  = 0; // Time of the newest deleted record
+    };
+
+    // Deletes up to limit of the oldest history records with Time < before.
+    HistTrim trimHist(long long before, int limit);
+
+    // Deletes up to limit of the oldest history records beyond the newest keep.
+    HistTrim trimHistRows(long long keep, int limit);
+
+    // Forgets up to limit of the transfer keys recorded before time before, and returns how many it forgot.
+    size_t expireKeys(long long before, int limit);
+
+    // Whether freed pages can be given back with vacuum() instead of rewriting the whole file.
+    bool incrementalVacuum();
+
+    // Switches an existing database to incremental vacuum, which takes one full VACUUM.
+    void enableIncrementalVacuum();
+
+    [[nodiscard]] long long freeBytes();
+
+    // Gives up to pages free pages back to the file system and returns how many bytes the file shrank by.
+    long long vacuum(int pages);
+
+    // Copies the WAL into the database and truncates it. Returns the size the WAL had.
+    long long checkpoint();
+
+    // Keeps the balances of xuid in memory until release, so get() does not touch the database.
+    void prefetch(std::string const& xuid) override;
+
+    void release(std::string const& xuid) override;
+
+    // Currencies without options of their own start at 0 and are not taxed.
+    void setOptions(std::string const& currency, Options options) { mOptions[currency] = options; }
+
+    // How long transOnce() remembers a key, 0 for ever.
+    void setKeyTtl(long long seconds) { mKeyTtl = seconds; }
+
+    // Called under the lock after every committed transfer with the row that was written to mtrans. Transfers made
+    // in a batch are reported once the whole batch is committed, and not at all if it is rolled back.
+    void setTransListener(TransListener listener) { mTransListener = std::move(listener); }
+
+    // Called under the lock with every committed balance change and the epoch it was given.
+    void setBalanceListener(BalanceListener listener) { mBalanceListener = std::move(listener); }
+
+    // Advances with every balance change, and whenever changes are rolled back. Anything computed from the balances
+    // at one epoch still holds as long as the epoch has not moved.
+    [[nodiscard]] uint64_t epoch() const { return mEpoch; }
+
+    long long get(std::string const& currency, std::string const& xuid) override;
+
+    bool trans(
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) override;
+
+    KeyedResult transOnce(
+        std::string const& key,
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) override;
+
+    std::optional<bool> keyResult(std::string const& key) override;
+
+    bool add(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool reduce(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool set(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool exchange(
+        std::string const& xuid,
+        std::string const& fromCurrency,
+        long long          fromVal,
+        std::string const& toCurrency,
+        long long          toVal,
+        std::string const& note
+    ) override;
+
+    std::vector<std::pair<std::string, long long>> ranking(std::string const& currency, unsigned short num) override;
+
+    std::vector<HistEntry>
+    hist(std::string const& currency, std::string const& xuid, long long after, int limit = -1) override;
+
+    void clearHist(int difftime) override;
+
+    BalanceSummary summary(std::string const& currency) override;
+
+    double gini(std::string const& currency) override;
+
+    size_t countAbove(std::string const& currency, long long threshold) override;
+
+    std::vector<size_t>
+    histogram(std::string const& currency, long long min, long long max, unsigned short buckets) override;
+
+    // Runs task under the lock and commits everything it does at once, trading per-call commits for one.
+    // If the commit fails nothing is kept and the exception is rethrown.
+    void batch(std::function<void()> const& task);
+
+private:
+    // Moves a money table keyed by XUID alone to one keyed by XUID and currency, keeping the balances in the
+    // default currency.
+    void migrate();
+
+    // A column of the first row of PRAGMA name, as an integer.
+    long long pragma(std::string const& name, int column = 0);
+
+    // A prepared statement for sql, prepared on first use and reset for the next one.
+    SQLite::Statement& statement(std::string const& sql);
+
+    Options const& options(std::string const& currency) const;
+
+    // Reads a balance from the money table, inserting the default row for a new account. Nothing in memory is
+    // touched, so it is safe inside a savepoint; the caller publishes created accounts once they are committed.
+    long long load(std::string const& currency, std::string const& xuid, bool& created);
+
+    // The pinned balance, or the stored one. Used by transfers, which publish what they wrote after the commit.
+    long long balance(std::string const& currency, std::string const& xuid);
+
+    // Writes one transfer and returns the resulting balances, or false if it cannot be made. Callers run it inside
+    // a savepoint and roll back on false, as it may already have written part of the transfer.
+    bool write(HistEntry const& entry, long long& fromMoney, long long& toMoney);
+
+    // Brings the in-memory state up to date with a committed transfer.
+    void publish(HistEntry const& entry, long long fromMoney, long long toMoney);
+
+    void changed(std::string const& currency, std::string const& xuid, long long money);
+
+    struct LoadingColumns {
+        BalanceColumns columns;
+        std::string    after; // The last XUID read so far
+    };
+
+    // The columns of a currency are filled from the money table on first use, then kept up to date by every write.
+    // The table is read in chunks in XUID order, and lock is released between them.
+    BalanceColumns& columns(std::string const& currency, std::unique_lock<std::recursive_mutex>& lock);
+
+    // Keeps the columns of currency, or the part of them loaded so far, up to date with a committed balance.
+    void updateColumns(std::string const& currency, std::string const& xuid, long long money);
+
+    std::recursive_mutex                                                        mMutex;
+    SQLite::Database                                                            mDb;
+    std::unordered_map<std::string, SQLite::Statement>                          mStatements;
+    std::unordered_map<std::string, Options>                                    mOptions;
+    TransListener                                                               mTransListener;
+    std::optional<std::vector<HistEntry>>                                       mBatched; // Set while a batch runs
+    BalanceListener                                                             mBalanceListener;
+    std::atomic<uint64_t>                                                       mEpoch  = 0;
+    long long                                                                   mKeyTtl = 0;
+    std::unordered_map<std::string, std::unordered_map<std::string, long long>> mBalances; // xuid -> currency -> money
+    std::unordered_map<std::string, BalanceColumns>                             mColumns;
+    std::unordered_map<std::string, LoadingColumns>                             mLoading;
+};
+
+} // namespace legacy_money
@@ -0,0 +1,250 @@
+#include "LedgerServer.h"
+#include "Rpc.h"
+#include <stdexcept>
+#include <vector>
+
+namespace legacy_money {
+
+// A client that keeps sending without letting a frame complete is dropped instead of growing the buffer forever.
+static constexpr size_t maxBufferedBytes = 64 * 1024 * 1024;
+
+LedgerServer::LedgerServer(Ledger& ledger, std::string const& address)
+: mLedger(ledger),
+  mListener(Socket::listen(address)),
+  mAcceptThread([this] { acceptLoop(); }) {}
+
+LedgerServer::~LedgerServer() {
+    mStopping = true;
+    mListener.shutdown();
+    mAcceptThread.join();
+    std::lock_guard lock{mMutex};
+    for (auto& connection : mConnections) {
+        connection.socket.shutdown();
+        connection.thread.join();
+    }
+}
+
+void LedgerServer::acceptLoop() {
+    while (!mStopping) {
+        Socket socket = mListener.accept();
+        if (!socket.valid()) {
+            continue;
+        }
+        std::lock_guard lock{mMutex};
+        if (mStopping) {
+            return;
+        }
+        for (auto it = mConnections.begin(); it != mConnections.end();) {
+            if (it->done) {
+                it->thread.join();
+                it = mConnections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        auto& connection  = mConnections.emplace_back();
+        connection.socket = std::move(socket);
+        connection.thread = std::thread([this, &connection] { serve(connection); });
+    }
+}
+
+void LedgerServer::serve(Connection& connection) {
+    std::string buffer, body, out;
+    char        chunk[64 * 1024];
+    while (size_t size = connection.socket.receive(chunk, sizeof(chunk))) {
+        buffer.append(chunk, size);
+        size_t                offset = 0;
+        std::vector<uint64_t> ids;
+        out.clear();
+        try {
+            mLedger.batch([&] {
+                while (rpc::takeFrame(buffer, offset, body)) {
+                    codec::Reader reader{body};
+                    ids.push_back(reader.getVarint());
+                    rpc::appendFrame(out, handle(body));
+                }
+            });
+        } catch (std::exception const& e) {
+            // The batch was rolled back, so none of the answers computed inside it hold.
+            out.clear();
+            for (auto id : ids) {
+                std::string response;
+                codec::putVarint(response, id);
+                response.push_back((char)rpc::Status::Error);
+                codec::putString(response, e.what());
+                rpc::appendFrame(out, response);
+            }
+        }
+        buffer.erase(0, offset);
+        if ((!out.empty() && !connection.socket.sendAll(out)) || buffer.size() > maxBufferedBytes) {
+            break;
+        }
+    }
+    connection.done = true;
+}
+
+std::string LedgerServer::handle(std::string const& request) {
+    codec::Reader reader{request};
+    uint64_t      id = reader.getVarint();
+    auto          op = (rpc::Op)reader.getByte();
+    std::string   response, result;
+    codec::putVarint(response, id);
+    auto checked = [&reader] {
+        if (!reader.ok() || !reader.empty()) {
+            throw std::runtime_error("Malformed request");
+        }
+    };
+    try {
+        switch (op) {
+        case rpc::Op::Hello: {
+            auto version = reader.getVarint();
+            checked();
+            if (version != rpc::protocolVersion) {
+                throw std::runtime_error("Unsupported protocol version " + std::to_string(version));
+            }
+            codec::putVarint(result, rpc::protocolVersion);
+            break;
+        }
+        case rpc::Op::Get: {
+            auto currency = reader.getString();
+            auto xuid     = reader.getString();
+            checked();
+            codec::putInt(result, mLedger.get(currency, xuid));
+            break;
+        }
+        case rpc::Op::Trans: {
+            auto currency = reader.getString();
+            auto from     = reader.getString();
+            auto to       = reader.getString();
+            auto val      = reader.getInt();
+            auto note     = reader.getString();
+            checked();
+            codec::putVarint(result, mLedger.trans(currency, from, to, val, note));
+            break;
+        }
+        case rpc::Op::TransOnce: {
+            auto key      = reader.getString();
+            auto currency = reader.getString();
+            auto from     = reader.getString();
+            auto to       = reader.getString();
+            auto val      = reader.getInt();
+            auto note     = reader.getString();
+            checked();
+            auto rv = mLedger.transOnce(key, currency, from, to, val, note);
+            codec::putVarint(result, rv.ok);
+            codec::putVarint(result, rv.duplicate);
+            break;
+        }
+        case rpc::Op::KeyResult: {
+            auto key = reader.getString();
+            checked();
+            auto rv = mLedger.keyResult(key);
+            codec::putVarint(result, rv.has_value());
+            codec::putVarint(result, rv.value_or(false));
+            break;
+        }
+        case rpc::Op::Add:
+        case rpc::Op::Reduce:
+        case rpc::Op::Set: {
+            auto currency = reader.getString();
+            auto xuid     = reader.getString();
+            auto money    = reader.getInt();
+            checked();
+            bool rv = op == rpc::Op::Add      ? mLedger.add(currency, xuid, money)
+                    : op == rpc::Op::Reduce ? mLedger.reduce(currency, xuid, money)
+                                            : mLedger.set(currency, xuid, money);
+            codec::putVarint(result, rv);
+            break;
+        }
+        case rpc::Op::Exchange: {
+            auto xuid         = reader.getString();
+            auto fromCurrency = reader.getString();
+            auto fromVal      = reader.getInt();
+            auto toCurrency   = reader.getString();
+            auto toVal        = reader.getInt();
+            auto note         = reader.getString();
+            checked();
+            codec::putVarint(result, mLedger.exchange(xuid, fromCurrency, fromVal, toCurrency, toVal, note));
+            break;
+        }
+        case rpc::Op::Ranking: {
+            auto currency = reader.getString();
+            auto num      = reader.getVarint();
+            checked();
+            auto ranking = mLedger.ranking(currency, (unsigned short)num);
+            codec::putVarint(result, ranking.size());
+            for (auto const& [xuid, money] : ranking) {
+                codec::putString(result, xuid);
+                codec::putInt(result, money);
+            }
+            break;
+        }
+        case rpc::Op::Hist: {
+            auto currency = reader.getString();
+            auto xuid     = reader.getString();
+            auto after    = reader.getInt();
+            auto limit    = reader.getInt();
+            checked();
+            auto entries = mLedger.hist(currency, xuid, after, (int)limit);
+            codec::putVarint(result, entries.size());
+            for (auto const& entry : entries) {
+                rpc::putHist(result, entry);
+            }
+            break;
+        }
+        case rpc::Op::ClearHist: {
+            auto difftime = reader.getInt();
+            checked();
+            mLedger.clearHist((int)difftime);
+            break;
+        }
+        case rpc::Op::Summary: {
+            auto currency = reader.getString();
+            checked();
+            auto summary = mLedger.summary(currency);
+            codec::putVarint(result, summary.accounts);
+            codec::putInt(result, summary.total);
+            codec::putInt(result, summary.min);
+            codec::putInt(result, summary.max);
+            break;
+        }
+        case rpc::Op::Gini: {
+            auto currency = reader.getString();
+            checked();
+            // Sent in millionths, which is all the precision a coefficient in [0, 1] needs here.
+            codec::putInt(result, (long long)(mLedger.gini(currency) * 1e6));
+            break;
+        }
+        case rpc::Op::CountAbove: {
+            auto currency  = reader.getString();
+            auto threshold = reader.getInt();
+            checked();
+            codec::putVarint(result, mLedger.countAbove(currency, threshold));
+            break;
+        }
+        case rpc::Op::Histogram: {
+            auto currency = reader.getString();
+            auto min      = reader.getInt();
+            auto max      = reader.getInt();
+            auto buckets  = reader.getVarint();
+            checked();
+            auto histogram = mLedger.histogram(currency, min, max, (unsigned short)buckets);
+            codec::putVarint(result, histogram.size());
+            for (auto count : histogram) {
+                codec::putVarint(result, count);
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown request " + std::to_string((int)op));
+        }
+        response.push_back((char)rpc::Status::Ok);
+        response += result;
+    } catch (std::exception const& e) {
+        response.push_back((char)rpc::Status::Error);
+        codec::putString(response, e.what());
+    }
+    return response;
+}
+
+} // namespace legacy_money
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Ledger.h"
+#include "Socket.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace legacy_money {
+
+// Serves a Ledger to RemoteLedger clients over the protocol in Rpc.h. Every complete request read from a
+// connection in one go is executed as a single Ledger::batch, so pipelining clients share commits.
+class LedgerServer {
+public:
+    // Starts listening right away; throws if the address cannot be bound.
+    LedgerServer(Ledger& ledger, std::string const& address);
+
+    ~LedgerServer();
+
+    LedgerServer(LedgerServer const&)            = delete;
+    LedgerServer& operator=(LedgerServer const&) = delete;
+
+private:
+    struct Connection {
+        Socket            socket;
+        std::thread       thread;
+        std::atomic<bool> done = false;
+    };
+
+    void acceptLoop();
+
+    void serve(Connection& connection);
+
+    std::string handle(std::string const& request);
+
+    Ledger&               mLedger;
+    Socket                mListener;
+    std::mutex            mMutex;
+    std::list<Connection> mConnections;
+    std::atomic<bool>     mStopping = false;
+    std::thread           mAcceptThread;
+};
+
+} // namespace legacy_money
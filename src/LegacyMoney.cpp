@@ -6,6 +6,8 @@
 #include "ll/api/command/CommandRegistrar.h"
 #include "ll/api/event/EventBus.h"
 #include "ll/api/event/command/ServerCommandRegisterEvent.h"
+#include "ll/api/event/player/PlayerDisconnectEvent.h"
+#include "ll/api/event/player/PlayerJoinEvent.h"
 #include "ll/api/i18n/I18n.h"
 #include "ll/api/io/Logger.h"
 #include "ll/api/mod/NativeMod.h"
@@ -19,7 +21,10 @@
 #include "mc/server/commands/CommandSelector.h"
 #include "mc/world/actor/player/Player.h"
 
+#include <chrono>
+#include <format>
 #include <string>
+#include <vector>
 
 namespace legacy_money {
 
@@ -59,6 +64,13 @@ struct TopMoney {
     int number;
 };
 
+struct MoneyAnalytics {
+    int threshold;
+};
+
+std::vector<std::string> renderRanking(unsigned short num);
+bool                     compactDatabase();
+
 void RegisterMoneyCommands() {
     using ll::command::CommandRegistrar;
     auto& command = ll::command::CommandRegistrar::getInstance(false).getOrCreateCommand(
@@ -350,29 +362,77 @@ void RegisterMoneyCommands() {
             }
         }
     );
-    command.overload<TopMoney>().text("top").optional("number").execute(
-        [&](CommandOrigin const& origin, CommandOutput& output, TopMoney const& param, Command const&) {
-            if (param.number) {
-                auto rank = LLMoney_Ranking(
-                    (param.number > 100 && origin.getPermissionsLevel() == CommandPermissionLevel::Any) ? 100
-                                                                                                        : param.number
+    command.overload<MoneyOthers>().text("compact").execute(
+        [&](CommandOrigin const& origin, CommandOutput& output, MoneyOthers const&, Command const&) {
+            if (origin.getPermissionsLevel() >= CommandPermissionLevel::GameDirectors) {
+                output.error(
+                    "Compacting rewrites the whole economy database and holds every economy call until it is done, if "
+                    "you confirm that, please type /money compact confirm"_tr()
                 );
-                output.success("Money ranking:"_tr());
-                for (auto i : rank) {
-                    auto info = ll::service::PlayerInfo::getInstance().fromXuid(i.first);
-                    if (info.has_value()) {
-                        output.success("{} {}{}", info->name, getConfig().currency_symbol, i.second);
-                    }
+            } else {
+                output.error("You don't have permission to do this"_tr());
+            }
+        }
+    );
+    command.overload<MoneyOthers>().text("compact").text("confirm").execute(
+        [&](CommandOrigin const& origin, CommandOutput& output, MoneyOthers const&, Command const&) {
+            if (origin.getPermissionsLevel() >= CommandPermissionLevel::GameDirectors) {
+                if (compactDatabase()) {
+                    output.success(
+                        "Compacting the economy database in the background, see the log for the result"_tr()
+                    );
+                } else {
+                    output.error("Only the server owning the economy database can compact it"_tr());
                 }
             } else {
-                auto rank = LLMoney_Ranking(10);
-                output.success("Money ranking:"_tr());
-                for (auto i : rank) {
-                    auto info = ll::service::PlayerInfo::getInstance().fromXuid(i.first);
-                    if (info.has_value()) {
-                        output.success("{} {}{}", info->name, getConfig().currency_symbol, i.second);
+                output.error("You don't have permission to do this"_tr());
+            }
+        }
+    );
+    command.overload<MoneyAnalytics>().text("analytics").optional("threshold").execute(
+        [&](CommandOrigin const& origin, CommandOutput& output, MoneyAnalytics const& param, Command const&) {
+            if (origin.getPermissionsLevel() >= CommandPermissionLevel::GameDirectors) {
+                auto const& symbol  = getConfig().currency_symbol;
+                auto        summary = LLMoney_Summary();
+                if (summary.accounts < 0) {
+                    output.error("Failed to collect analytics"_tr());
+                    return;
+                }
+                auto count = summary.accounts, total = summary.total;
+                output.success("Accounts: "_tr() + std::to_string(count));
+                output.success("Total balance: "_tr() + symbol + std::to_string(total));
+                output.success("Average balance: "_tr() + symbol + std::to_string(count ? total / count : 0));
+                output.success("Gini coefficient: "_tr() + std::format("{:.3f}", LLMoney_Gini()));
+                if (param.threshold) {
+                    output.success(
+                        "Accounts above "_tr() + symbol + std::to_string(param.threshold) + ": "
+                        + std::to_string(LLMoney_CountAbove(param.threshold))
+                    );
+                }
+                if (count > 0 && summary.max >= 0) {
+                    auto histogram = LLMoney_Histogram(0, summary.max, 10);
+                    // floor((max + 1) * i / 10), split so that it cannot overflow even at LLONG_MAX.
+                    auto width = (unsigned long long)summary.max + 1;
+                    auto bound = [&](unsigned long long i) { return width / 10 * i + width % 10 * i / 10; };
+                    output.success("Balance distribution:"_tr());
+                    for (size_t i = 0; i < histogram.size(); ++i) {
+                        output.success("{}{} - {}{}: {}", symbol, bound(i), symbol, bound(i + 1) - 1, histogram[i]);
                     }
                 }
+            } else {
+                output.error("You don't have permission to do this"_tr());
+            }
+        }
+    );
+    command.overload<TopMoney>().text("top").optional("number").execute(
+        [&](CommandOrigin const& origin, CommandOutput& output, TopMoney const& param, Command const&) {
+            int number = param.number ? param.number : 10;
+            if (number > 100 && origin.getPermissionsLevel() == CommandPermissionLevel::Any) {
+                number = 100;
+            }
+            output.success("Money ranking:"_tr());
+            for (auto const& line : renderRanking((unsigned short)number)) {
+                output.success(line);
             }
         }
     );
@@ -408,9 +468,19 @@ bool loadConfig() {
 
 MoneyConfig& getConfig() { return config; }
 
+// Only active while the mod is enabled, since they post to the worker that disable() stops.
+static ll::event::ListenerPtr joinListener;
+static ll::event::ListenerPtr disconnectListener;
+
 bool initDatabase();
+void startDatabase();
+void prefetchPlayer(std::string const& xuid);
+void releasePlayer(std::string const& xuid);
+void runDeferredTasks();
+void closeDatabase();
 
 bool LegacyMoney::load() {
+    auto begin = std::chrono::steady_clock::now();
     if (!loadConfig() || !initDatabase()) {
         return false;
     }
@@ -422,12 +492,35 @@ bool LegacyMoney::load() {
         }
         return true;
     });
+    getSelf().getLogger().debug(
+        "Loaded in {}ms",
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()
+    );
     return true;
 }
 
-bool LegacyMoney::enable() { return true; }
+bool LegacyMoney::enable() {
+    startDatabase();
+    using namespace ll::event;
+    joinListener = EventBus::getInstance().emplaceListener<player::PlayerJoinEvent>([](player::PlayerJoinEvent& event) {
+        prefetchPlayer(event.self().getXuid());
+    });
+    disconnectListener = EventBus::getInstance().emplaceListener<player::PlayerDisconnectEvent>(
+        [](player::PlayerDisconnectEvent& event) { releasePlayer(event.self().getXuid()); }
+    );
+    runDeferredTasks();
+    return true;
+}
 
-bool LegacyMoney::disable() { return true; }
+bool LegacyMoney::disable() {
+    auto& bus = ll::event::EventBus::getInstance();
+    bus.removeListener(joinListener);
+    bus.removeListener(disconnectListener);
+    joinListener.reset();
+    disconnectListener.reset();
+    closeDatabase();
+    return true;
+}
 
 } // namespace legacy_money
 
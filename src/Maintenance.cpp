@@ -0,0 +1,70 @@
+#include "Maintenance.h"
+#include <algorithm>
+#include <ctime>
+
+namespace legacy_money {
+
+// Small enough that a slice holds the ledger for a few milliseconds at most.
+static constexpr int trimSlice   = 2000;
+static constexpr int vacuumSlice = 256;
+
+Maintenance::Maintenance(Ledger& ledger, Options options)
+: mLedger(ledger),
+  mOptions(options),
+  mNextOptimize(std::chrono::steady_clock::now() + options.optimizeInterval) {}
+
+Maintenance::Report Maintenance::run() {
+    auto   begin    = std::chrono::steady_clock::now();
+    auto   deadline = begin + mOptions.budget;
+    auto   within   = [&] { return std::chrono::steady_clock::now() < deadline; };
+    Report report;
+    auto   count = [&](Ledger::HistTrim slice) {
+        report.deletedRows   += slice.deleted;
+        report.newestDeleted  = std::max(report.newestDeleted, slice.newest);
+        return slice.deleted == (size_t)trimSlice;
+    };
+    bool left = false;
+
+    if (mOptions.retention > 0) {
+        long long before = std::time(nullptr) - mOptions.retention;
+        bool      more   = true;
+        while (more && within()) {
+            more = count(mLedger.trimHist(before, trimSlice));
+        }
+        left = more;
+    }
+    if (mOptions.retentionRows > 0 && within()) {
+        bool more = true;
+        while (more && within()) {
+            more = count(mLedger.trimHistRows(mOptions.retentionRows, trimSlice));
+        }
+        left = left || more;
+    }
+    if (mOptions.keyTtl > 0 && within()) {
+        long long before  = std::time(nullptr) - mOptions.keyTtl;
+        long long expired = trimSlice;
+        while (expired == trimSlice && within()) {
+            expired             = (long long)mLedger.expireKeys(before, trimSlice);
+            report.expiredKeys += expired;
+        }
+        left = left || expired == trimSlice;
+    }
+    // A database that was never switched to incremental vacuum frees nothing here, so it stops after one slice.
+    for (long long reclaimed = 1; reclaimed > 0 && within() && mLedger.freeBytes() > 0;) {
+        reclaimed              = mLedger.vacuum(vacuumSlice);
+        report.reclaimedBytes += reclaimed;
+        left                   = left || (reclaimed > 0 && !within());
+    }
+    if (std::chrono::steady_clock::now() >= mNextOptimize && within()) {
+        mLedger.optimize();
+        report.optimized = true;
+        mNextOptimize    = std::chrono::steady_clock::now() + mOptions.optimizeInterval;
+    }
+    // Always done, since this is what keeps the WAL from growing while the server is busy.
+    report.walBytes = mLedger.checkpoint();
+    report.finished = !left;
+    report.spent    = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+    return report;
+}
+
+} // namespace legacy_money
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Ledger.h"
+#include <chrono>
+#include <cstddef>
+
+namespace legacy_money {
+
+// Keeps economy.db from growing without bound: trims history by age and count, expires transfer keys, gives freed
+// pages back to the file system, refreshes the query planner statistics and truncates the WAL. Work is done in slices
+// that lock the ledger one at a time, and a run starts no new slice once its budget is spent.
+class Maintenance {
+public:
+    struct Options {
+        long long                 retention     = 0; // Seconds of history to keep, 0 to keep all of it
+        long long                 retentionRows = 0; // History records to keep, 0 for no limit
+        long long                 keyTtl        = 0; // Seconds transfer keys are kept, 0 to keep them forever
+        std::chrono::milliseconds budget{50};
+        std::chrono::seconds      optimizeInterval{6 * 60 * 60};
+    };
+
+    struct Report {
+        size_t                    deletedRows    = 0;
+        long long                 newestDeleted  = 0; // Time of the newest deleted history record
+        size_t                    expiredKeys    = 0;
+        long long                 reclaimedBytes = 0; // Freed pages given back to the file system
+        long long                 walBytes       = 0; // Size of the WAL before it was checkpointed and truncated
+        bool                      optimized      = false;
+        bool                      finished       = true; // False if the budget ran out with work left
+        std::chrono::microseconds spent{};
+    };
+
+    Maintenance(Ledger& ledger, Options options);
+
+    Report run();
+
+private:
+    Ledger&                               mLedger;
+    Options                               mOptions;
+    std::chrono::steady_clock::time_point mNextOptimize;
+};
+
+} // namespace legacy_money
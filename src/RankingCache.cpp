@@ -0,0 +1,59 @@
+#include "RankingCache.h"
+#include <algorithm>
+
+namespace legacy_money {
+
+// Lengths are chosen by players and plugins, so the number of cached rankings is bounded.
+static constexpr size_t maxSlots = 64;
+
+std::shared_ptr<RankingCache::Entry const>
+RankingCache::find(std::string const& currency, unsigned short num, std::optional<uint64_t> epoch) {
+    std::lock_guard lock{mMutex};
+    auto            it = mSlots.find({currency, num});
+    if (it == mSlots.end()) {
+        return nullptr;
+    }
+    auto& slot = it->second;
+    if ((epoch && slot.epoch == epoch) || std::chrono::steady_clock::now() - slot.built < mStaleness) {
+        return slot.entry;
+    }
+    return nullptr;
+}
+
+void RankingCache::insert(
+    std::string const&           currency,
+    unsigned short               num,
+    std::optional<uint64_t>      epoch,
+    std::shared_ptr<Entry const> entry
+) {
+    std::lock_guard lock{mMutex};
+    if (mSlots.size() >= maxSlots && !mSlots.contains({currency, num})) {
+        mSlots.clear();
+    }
+    mSlots[{currency, num}] = {std::move(entry), epoch, std::chrono::steady_clock::now()};
+}
+
+void RankingCache::update(std::string const& currency, std::string const& xuid, long long money, uint64_t epoch) {
+    std::lock_guard lock{mMutex};
+    for (auto it = mSlots.lower_bound({currency, 0}); it != mSlots.end() && it->first.first == currency; ++it) {
+        auto& [key, slot] = *it;
+        if (slot.epoch != epoch - 1) {
+            continue;
+        }
+        auto const& rows = slot.entry->rows;
+        auto        row  = std::find_if(rows.begin(), rows.end(), [&](auto const& row) { return row.first == xuid; });
+        // Ties are ordered arbitrarily, so reaching the last balance may already reorder the ranking.
+        bool affected = row != rows.end() ? row->second != money
+                                          : rows.size() < key.second || (!rows.empty() && money >= rows.back().second);
+        if (!affected) {
+            slot.epoch = epoch;
+        }
+    }
+}
+
+void RankingCache::clear() {
+    std::lock_guard lock{mMutex};
+    mSlots.clear();
+}
+
+} // namespace legacy_money
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace legacy_money {
+
+// Recent ranking results by currency and length, with the lines /money top prints for them. A result is stamped
+// with the ledger epoch it was read at and stays current as long as every balance change since then is known to
+// leave it alone. Results may also be served for a while after they went out of date, which is the only way they
+// are reused when the epoch is not known, e.g. on a client of a shared ledger.
+class RankingCache {
+public:
+    struct Entry {
+        std::vector<std::pair<std::string, long long>> rows;
+        std::optional<std::vector<std::string>>        lines;
+    };
+
+    explicit RankingCache(std::chrono::milliseconds staleness) : mStaleness(staleness) {}
+
+    std::shared_ptr<Entry const> find(std::string const& currency, unsigned short num, std::optional<uint64_t> epoch);
+
+    // epoch must have been read before the rows, so a change racing with the query can only make the entry stale.
+    void insert(
+        std::string const&           currency,
+        unsigned short               num,
+        std::optional<uint64_t>      epoch,
+        std::shared_ptr<Entry const> entry
+    );
+
+    // Moves every entry that was current before this change to epoch, unless the change reaches into it.
+    void update(std::string const& currency, std::string const& xuid, long long money, uint64_t epoch);
+
+    void clear();
+
+private:
+    struct Slot {
+        std::shared_ptr<Entry const>          entry;
+        std::optional<uint64_t>               epoch;
+        std::chrono::steady_clock::time_point built;
+    };
+
+    std::chrono::milliseconds                              mStaleness;
+    std::mutex                                             mMutex;
+    std::map<std::pair<std::string, unsigned short>, Slot> mSlots;
+};
+
+} // namespace legacy_money
@@ -0,0 +1,353 @@
+#include "RemoteLedger.h"
+#include <stdexcept>
+
+namespace legacy_money {
+
+RemoteLedger::RemoteLedger(std::string address, std::chrono::milliseconds cacheTtl, std::chrono::milliseconds timeout)
+: mAddress(std::move(address)),
+  mCacheTtl(cacheTtl),
+  mTimeout(timeout) {}
+
+RemoteLedger::~RemoteLedger() {
+    {
+        std::lock_guard lock{mMutex};
+        if (mConnected) {
+            mSocket.shutdown();
+        }
+    }
+    if (mReader.joinable()) {
+        mReader.join();
+    }
+}
+
+void RemoteLedger::connect() {
+    if (mReader.joinable()) {
+        mReader.join();
+    }
+    mSocket = Socket::connect(mAddress);
+    // Bounds the handshake, which runs under mMutex. The reader waits for answers without a limit, call() has one.
+    mSocket.setReceiveTimeout(mTimeout);
+
+    std::string request, frame;
+    codec::putVarint(request, mNextId++);
+    request.push_back((char)rpc::Op::Hello);
+    codec::putVarint(request, rpc::protocolVersion);
+    rpc::appendFrame(frame, request);
+    if (!mSocket.sendAll(frame)) {
+        throw std::runtime_error("Failed to reach ledger server " + mAddress);
+    }
+    std::string buffer, response;
+    size_t      offset = 0;
+    char        chunk[256];
+    while (!rpc::takeFrame(buffer, offset, response)) {
+        size_t size = mSocket.receive(chunk, sizeof(chunk));
+        if (!size) {
+            throw std::runtime_error("Ledger server " + mAddress + " closed the connection or did not answer");
+        }
+        buffer.append(chunk, size);
+    }
+    codec::Reader reader{response};
+    reader.getVarint();
+    if ((rpc::Status)reader.getByte() != rpc::Status::Ok) {
+        throw std::runtime_error("Ledger server " + mAddress + " refused the connection: " + reader.getString());
+    }
+    mSocket.setReceiveTimeout(std::chrono::milliseconds{0});
+    mConnected = true;
+    mReader    = std::thread([this] { readLoop(); });
+}
+
+void RemoteLedger::readLoop() {
+    std::string buffer, body;
+    char        chunk[64 * 1024];
+    bool        broken = false;
+    while (size_t size = mSocket.receive(chunk, sizeof(chunk))) {
+        buffer.append(chunk, size);
+        size_t offset = 0;
+        while (rpc::takeFrame(buffer, offset, body)) {
+            codec::Reader reader{body};
+            uint64_t      id     = reader.getVarint();
+            auto          status = (rpc::Status)reader.getByte();
+            Pending       pending;
+            {
+                std::lock_guard lock{mMutex};
+                if (mPending.empty() || mPending.front().id != id) {
+                    broken = true;
+                    break;
+                }
+                pending = std::move(mPending.front());
+                mPending.pop_front();
+            }
+            if (status == rpc::Status::Ok) {
+                pending.promise.set_value(std::string{reader.remaining()});
+            } else {
+                pending.promise.set_exception(std::make_exception_ptr(std::runtime_error(reader.getString())));
+            }
+        }
+        if (broken) {
+            break;
+        }
+        buffer.erase(0, offset);
+    }
+    std::lock_guard lock{mMutex};
+    mConnected = false;
+    for (auto& pending : mPending) {
+        pending.promise.set_exception(
+            std::make_exception_ptr(std::runtime_error("Lost connection to ledger server " + mAddress))
+        );
+    }
+    mPending.clear();
+}
+
+std::future<std::string> RemoteLedger::send(rpc::Op op, std::string const& args) {
+    std::lock_guard lock{mMutex};
+    if (!mConnected) {
+        connect();
+    }
+    std::string request, frame;
+    codec::putVarint(request, mNextId);
+    request.push_back((char)op);
+    request += args;
+    rpc::appendFrame(frame, request);
+    auto& pending  = mPending.emplace_back(Pending{mNextId++, {}});
+    auto  response = pending.promise.get_future();
+    if (!mSocket.sendAll(frame)) {
+        // The reader fails everything still pending once it sees the connection close.
+        mSocket.shutdown();
+    }
+    return response;
+}
+
+std::string RemoteLedger::call(rpc::Op op, std::string const& args) {
+    auto response = send(op, args);
+    if (mTimeout.count() > 0 && response.wait_for(mTimeout) != std::future_status::ready) {
+        // Everything behind the lost answer would wait as well, so start over on a new connection.
+        {
+            std::lock_guard lock{mMutex};
+            if (mConnected) {
+                mSocket.shutdown();
+            }
+        }
+        throw std::runtime_error(
+            "Ledger server " + mAddress + " did not answer within " + std::to_string(mTimeout.count()) + "ms"
+        );
+    }
+    return response.get();
+}
+
+void RemoteLedger::invalidate(std::string const& xuid) {
+    std::lock_guard lock{mCacheMutex};
+    mCache.erase(xuid);
+}
+
+long long RemoteLedger::get(std::string const& currency, std::string const& xuid) {
+    auto now = std::chrono::steady_clock::now();
+    if (mCacheTtl.count() > 0) {
+        std::lock_guard lock{mCacheMutex};
+        if (auto balances = mCache.find(xuid); balances != mCache.end()) {
+            if (auto it = balances->second.find(currency); it != balances->second.end() && it->second.expiry > now) {
+                return it->second.money;
+            }
+        }
+    }
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, xuid);
+    auto          result = call(rpc::Op::Get, args);
+    codec::Reader reader{result};
+    long long     money = reader.getInt();
+    if (mCacheTtl.count() > 0) {
+        std::lock_guard lock{mCacheMutex};
+        mCache[xuid][currency] = {money, now + mCacheTtl};
+    }
+    return money;
+}
+
+bool RemoteLedger::trans(
+    std::string const& currency,
+    std::string const& from,
+    std::string const& to,
+    long long          val,
+    std::string const& note
+) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, from);
+    codec::putString(args, to);
+    codec::putInt(args, val);
+    codec::putString(args, note);
+    auto result = call(rpc::Op::Trans, args);
+    invalidate(from);
+    invalidate(to);
+    return codec::Reader{result}.getVarint();
+}
+
+KeyedResult RemoteLedger::transOnce(
+    std::string const& key,
+    std::string const& currency,
+    std::string const& from,
+    std::string const& to,
+    long long          val,
+    std::string const& note
+) {
+    std::string args;
+    codec::putString(args, key);
+    codec::putString(args, currency);
+    codec::putString(args, from);
+    codec::putString(args, to);
+    codec::putInt(args, val);
+    codec::putString(args, note);
+    auto result = call(rpc::Op::TransOnce, args);
+    invalidate(from);
+    invalidate(to);
+    codec::Reader reader{result};
+    KeyedResult   rv;
+    rv.ok        = reader.getVarint();
+    rv.duplicate = reader.getVarint();
+    return rv;
+}
+
+std::optional<bool> RemoteLedger::keyResult(std::string const& key) {
+    std::string args;
+    codec::putString(args, key);
+    auto          result = call(rpc::Op::KeyResult, args);
+    codec::Reader reader{result};
+    bool          found = reader.getVarint();
+    bool          ok    = reader.getVarint();
+    return found ? std::optional<bool>{ok} : std::nullopt;
+}
+
+bool RemoteLedger::add(std::string const& currency, std::string const& xuid, long long money) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, xuid);
+    codec::putInt(args, money);
+    auto result = call(rpc::Op::Add, args);
+    invalidate(xuid);
+    return codec::Reader{result}.getVarint();
+}
+
+bool RemoteLedger::reduce(std::string const& currency, std::string const& xuid, long long money) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, xuid);
+    codec::putInt(args, money);
+    auto result = call(rpc::Op::Reduce, args);
+    invalidate(xuid);
+    return codec::Reader{result}.getVarint();
+}
+
+bool RemoteLedger::set(std::string const& currency, std::string const& xuid, long long money) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, xuid);
+    codec::putInt(args, money);
+    auto result = call(rpc::Op::Set, args);
+    invalidate(xuid);
+    return codec::Reader{result}.getVarint();
+}
+
+bool RemoteLedger::exchange(
+    std::string const& xuid,
+    std::string const& fromCurrency,
+    long long          fromVal,
+    std::string const& toCurrency,
+    long long          toVal,
+    std::string const& note
+) {
+    std::string args;
+    codec::putString(args, xuid);
+    codec::putString(args, fromCurrency);
+    codec::putInt(args, fromVal);
+    codec::putString(args, toCurrency);
+    codec::putInt(args, toVal);
+    codec::putString(args, note);
+    auto result = call(rpc::Op::Exchange, args);
+    invalidate(xuid);
+    return codec::Reader{result}.getVarint();
+}
+
+std::vector<std::pair<std::string, long long>> RemoteLedger::ranking(std::string const& currency, unsigned short num) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putVarint(args, num);
+    auto                                           result = call(rpc::Op::Ranking, args);
+    codec::Reader                                  reader{result};
+    std::vector<std::pair<std::string, long long>> rv(reader.getVarint());
+    for (auto& [xuid, money] : rv) {
+        xuid  = reader.getString();
+        money = reader.getInt();
+    }
+    return rv;
+}
+
+std::vector<HistEntry>
+RemoteLedger::hist(std::string const& currency, std::string const& xuid, long long after, int limit) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putString(args, xuid);
+    codec::putInt(args, after);
+    codec::putInt(args, limit);
+    auto                   result = call(rpc::Op::Hist, args);
+    codec::Reader          reader{result};
+    std::vector<HistEntry> rv(reader.getVarint());
+    for (auto& entry : rv) {
+        entry = rpc::getHist(reader);
+    }
+    return rv;
+}
+
+void RemoteLedger::clearHist(int difftime) {
+    std::string args;
+    codec::putInt(args, difftime);
+    call(rpc::Op::ClearHist, args);
+}
+
+BalanceSummary RemoteLedger::summary(std::string const& currency) {
+    std::string args;
+    codec::putString(args, currency);
+    auto           result = call(rpc::Op::Summary, args);
+    codec::Reader  reader{result};
+    BalanceSummary rv;
+    rv.accounts = reader.getVarint();
+    rv.total    = reader.getInt();
+    rv.min      = reader.getInt();
+    rv.max      = reader.getInt();
+    return rv;
+}
+
+double RemoteLedger::gini(std::string const& currency) {
+    std::string args;
+    codec::putString(args, currency);
+    auto result = call(rpc::Op::Gini, args);
+    return (double)codec::Reader{result}.getInt() / 1e6;
+}
+
+size_t RemoteLedger::countAbove(std::string const& currency, long long threshold) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putInt(args, threshold);
+    auto result = call(rpc::Op::CountAbove, args);
+    return codec::Reader{result}.getVarint();
+}
+
+std::vector<size_t>
+RemoteLedger::histogram(std::string const& currency, long long min, long long max, unsigned short buckets) {
+    std::string args;
+    codec::putString(args, currency);
+    codec::putInt(args, min);
+    codec::putInt(args, max);
+    codec::putVarint(args, buckets);
+    auto                result = call(rpc::Op::Histogram, args);
+    codec::Reader       reader{result};
+    std::vector<size_t> rv(reader.getVarint());
+    for (auto& count : rv) {
+        count = reader.getVarint();
+    }
+    return rv;
+}
+
+void RemoteLedger::prefetch(std::string const& xuid) { get({}, xuid); }
+
+void RemoteLedger::release(std::string const& xuid) { invalidate(xuid); }
+
+} // namespace legacy_money
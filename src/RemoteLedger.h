@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Rpc.h"
+#include "Socket.h"
+#include "Store.h"
+#include <chrono>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace legacy_money {
+
+// A Store forwarding every call to a LedgerServer. Calls from several threads are pipelined on one connection,
+// which is reopened on the next call after it drops. Balances read through get() are cached for cacheTtl;
+// writes made through this client drop the cached balances they touch.
+// A call that gets no answer within timeout (0 for no limit) throws and drops the connection. A write that fails
+// this way may still have been committed by the server.
+class RemoteLedger : public Store {
+public:
+    RemoteLedger(std::string address, std::chrono::milliseconds cacheTtl, std::chrono::milliseconds timeout);
+
+    ~RemoteLedger() override;
+
+    long long get(std::string const& currency, std::string const& xuid) override;
+
+    bool trans(
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) override;
+
+    // Sent once, like every other call. One that throws may still have been made; calling again with the same key
+    // is what makes the retry safe, so it is left to the caller.
+    KeyedResult transOnce(
+        std::string const& key,
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) override;
+
+    std::optional<bool> keyResult(std::string const& key) override;
+
+    bool add(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool reduce(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool set(std::string const& currency, std::string const& xuid, long long money) override;
+
+    bool exchange(
+        std::string const& xuid,
+        std::string const& fromCurrency,
+        long long          fromVal,
+        std::string const& toCurrency,
+        long long          toVal,
+        std::string const& note
+    ) override;
+
+    std::vector<std::pair<std::string, long long>> ranking(std::string const& currency, unsigned short num) override;
+
+    std::vector<HistEntry>
+    hist(std::string const& currency, std::string const& xuid, long long after, int limit = -1) override;
+
+    void clearHist(int difftime) override;
+
+    BalanceSummary summary(std::string const& currency) override;
+
+    double gini(std::string const& currency) override;
+
+    size_t countAbove(std::string const& currency, long long threshold) override;
+
+    std::vector<size_t>
+    histogram(std::string const& currency, long long min, long long max, unsigned short buckets) override;
+
+    void prefetch(std::string const& xuid) override;
+
+    void release(std::string const& xuid) override;
+
+    // Sends a request without waiting for its answer. The future yields the result payload or throws.
+    std::future<std::string> send(rpc::Op op, std::string const& args);
+
+private:
+    struct Cached {
+        long long                             money;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    struct Pending {
+        uint64_t                  id;
+        std::promise<std::string> promise;
+    };
+
+    void connect();
+
+    void readLoop();
+
+    std::string call(rpc::Op op, std::string const& args);
+
+    // Drops the cached balances of xuid in every currency.
+    void invalidate(std::string const& xuid);
+
+    std::string                                                              mAddress;
+    std::chrono::milliseconds                                                mCacheTtl;
+    std::chrono::milliseconds                                                mTimeout;
+    std::mutex                                                               mMutex;
+    Socket                                                                   mSocket;
+    bool                                                                     mConnected = false;
+    std::thread                                                              mReader;
+    uint64_t                                                                 mNextId = 0;
+    std::deque<Pending>                                                      mPending;
+    std::mutex                                                               mCacheMutex;
+    std::unordered_map<std::string, std::unordered_map<std::string, Cached>> mCache; // xuid -> currency -> balance
+};
+
+} // namespace legacy_money
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Codec.h"
+#include "Store.h"
+#include <cstdint>
+#include <string>
+
+// Wire format of the shared ledger service. Every message is a frame of a 4-byte little-endian length followed by
+// the body. Requests are: varint id, op byte, arguments, which start with the currency id for per-currency ops.
+// Responses are: varint id, status byte, result or error text.
+// Responses come back in request order, so clients may pipeline any number of requests on one connection.
+namespace legacy_money::rpc {
+
+constexpr uint64_t protocolVersion = 2;
+
+enum class Op : uint8_t {
+    Hello,
+    Get,
+    Trans,
+    Add,
+    Reduce,
+    Set,
+    Ranking,
+    Hist,
+    ClearHist,
+    Summary,
+    Gini,
+    CountAbove,
+    Histogram,
+    Exchange,
+    TransOnce,
+    KeyResult,
+};
+
+enum class Status : uint8_t { Ok, Error };
+
+inline void appendFrame(std::string& out, std::string const& body) {
+    auto size = (uint32_t)body.size();
+    for (int i = 0; i < 4; ++i) {
+        out.push_back((char)(size >> (8 * i)));
+    }
+    out += body;
+}
+
+// Reads the frame starting at offset into body and advances offset past it, or returns false if the frame is not
+// complete yet.
+inline bool takeFrame(std::string& buffer, size_t& offset, std::string& body) {
+    if (buffer.size() - offset < 4) {
+        return false;
+    }
+    uint32_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+        size |= (uint32_t)(uint8_t)buffer[offset + i] << (8 * i);
+    }
+    if (buffer.size() - offset - 4 < size) {
+        return false;
+    }
+    body.assign(buffer, offset + 4, size);
+    offset += 4 + size;
+    return true;
+}
+
+inline void putHist(std::string& out, HistEntry const& entry) {
+    codec::putString(out, entry.from);
+    codec::putString(out, entry.to);
+    codec::putInt(out, entry.money);
+    codec::putInt(out, entry.time);
+    codec::putString(out, entry.note);
+    codec::putString(out, entry.currency);
+}
+
+inline HistEntry getHist(codec::Reader& reader) {
+    HistEntry entry;
+    entry.from     = reader.getString();
+    entry.to       = reader.getString();
+    entry.money    = reader.getInt();
+    entry.time     = reader.getInt();
+    entry.note     = reader.getString();
+    entry.currency = reader.getString();
+    return entry;
+}
+
+} // namespace legacy_money::rpc
@@ -0,0 +1,192 @@
+#include "Socket.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace legacy_money {
+
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+
+static void closeNative(NativeSocket handle) { closesocket(handle); }
+
+static void startup() {
+    static bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    if (!started) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+}
+#else
+using NativeSocket = int;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static void closeNative(NativeSocket handle) { close(handle); }
+
+static void startup() {}
+#endif
+
+static addrinfo* resolve(std::string const& address, bool passive) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Invalid address " + address + ", expected host:port");
+    }
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+    addrinfo    hints{};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = passive ? AI_PASSIVE : 0;
+    addrinfo* result  = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) {
+        throw std::runtime_error("Failed to resolve " + address);
+    }
+    return result;
+}
+
+static bool isLoopback(sockaddr const* address) {
+    if (address->sa_family == AF_INET) {
+        return (ntohl(((sockaddr_in const*)address)->sin_addr.s_addr) >> 24) == 127;
+    }
+    if (address->sa_family == AF_INET6) {
+        auto const& ip = ((sockaddr_in6 const*)address)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(&ip);
+    }
+    return false;
+}
+
+static void setNoDelay(NativeSocket handle) {
+    int flag = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (char const*)&flag, sizeof(flag));
+}
+
+Socket::~Socket() {
+    if (valid()) {
+        closeNative((NativeSocket)mHandle);
+    }
+}
+
+Socket::Socket(Socket&& other) noexcept : mHandle(std::exchange(other.mHandle, invalidHandle)) {}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    if (this != &other) {
+        if (valid()) {
+            closeNative((NativeSocket)mHandle);
+        }
+        mHandle = std::exchange(other.mHandle, invalidHandle);
+    }
+    return *this;
+}
+
+Socket Socket::listen(std::string const& address) {
+    startup();
+    addrinfo* info     = resolve(address, true);
+    bool      loopback = false;
+    for (auto* it = info; it; it = it->ai_next) {
+        if (!isLoopback(it->ai_addr)) {
+            continue;
+        }
+        loopback            = true;
+        NativeSocket handle = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if ((intptr_t)handle == invalidHandle) {
+            continue;
+        }
+        int reuse = 1;
+        setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (char const*)&reuse, sizeof(reuse));
+        if (::bind(handle, it->ai_addr, (int)it->ai_addrlen) == 0 && ::listen(handle, SOMAXCONN) == 0) {
+            freeaddrinfo(info);
+            return Socket{(intptr_t)handle};
+        }
+        closeNative(handle);
+    }
+    freeaddrinfo(info);
+    if (!loopback) {
+        throw std::runtime_error("Refusing to listen on " + address + ", only loopback addresses are allowed");
+    }
+    throw std::runtime_error("Failed to listen on " + address);
+}
+
+Socket Socket::connect(std::string const& address) {
+    startup();
+    addrinfo* info = resolve(address, false);
+    for (auto* it = info; it; it = it->ai_next) {
+        NativeSocket handle = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if ((intptr_t)handle == invalidHandle) {
+            continue;
+        }
+        if (::connect(handle, it->ai_addr, (int)it->ai_addrlen) == 0) {
+            freeaddrinfo(info);
+            setNoDelay(handle);
+            return Socket{(intptr_t)handle};
+        }
+        closeNative(handle);
+    }
+    freeaddrinfo(info);
+    throw std::runtime_error("Failed to connect to " + address);
+}
+
+Socket Socket::accept() {
+    NativeSocket handle = ::accept((NativeSocket)mHandle, nullptr, nullptr);
+    if ((intptr_t)handle == invalidHandle) {
+        return {};
+    }
+    setNoDelay(handle);
+    return Socket{(intptr_t)handle};
+}
+
+bool Socket::sendAll(std::string_view data) {
+    while (!data.empty()) {
+#ifdef _WIN32
+        auto sent = ::send((NativeSocket)mHandle, data.data(), (int)data.size(), 0);
+#else
+        // A peer that went away must not kill the process with SIGPIPE.
+        auto sent = ::send((NativeSocket)mHandle, data.data(), data.size(), MSG_NOSIGNAL);
+#endif
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix((size_t)sent);
+    }
+    return true;
+}
+
+size_t Socket::receive(char* buffer, size_t size) {
+    auto received = ::recv((NativeSocket)mHandle, buffer, (int)size, 0);
+    return received > 0 ? (size_t)received : 0;
+}
+
+void Socket::setReceiveTimeout(std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+    DWORD value = (DWORD)timeout.count();
+#else
+    timeval value{(time_t)(timeout.count() / 1000), (suseconds_t)(timeout.count() % 1000 * 1000)};
+#endif
+    setsockopt((NativeSocket)mHandle, SOL_SOCKET, SO_RCVTIMEO, (char const*)&value, sizeof(value));
+}
+
+void Socket::shutdown() {
+#ifdef _WIN32
+    ::shutdown((NativeSocket)mHandle, SD_BOTH);
+    // Winsock does not wake accept() on shutdown, only on close.
+    closeNative((NativeSocket)mHandle);
+    mHandle = invalidHandle;
+#else
+    ::shutdown((NativeSocket)mHandle, SHUT_RDWR);
+#endif
+}
+
+} // namespace legacy_money
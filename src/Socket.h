@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace legacy_money {
+
+// A blocking TCP socket over Winsock or BSD sockets. Addresses are "host:port"; failures to listen or connect throw.
+class Socket {
+public:
+    Socket() = default;
+
+    ~Socket();
+
+    Socket(Socket&& other) noexcept;
+
+    Socket& operator=(Socket&& other) noexcept;
+
+    Socket(Socket const&)            = delete;
+    Socket& operator=(Socket const&) = delete;
+
+    // Anyone who can connect may change any balance, so only loopback addresses are accepted.
+    static Socket listen(std::string const& address);
+
+    static Socket connect(std::string const& address);
+
+    [[nodiscard]] bool valid() const { return mHandle != invalidHandle; }
+
+    // Blocks until a client connects, or returns an invalid socket once this one is closed.
+    Socket accept();
+
+    bool sendAll(std::string_view data);
+
+    // Returns the number of bytes read, or 0 when the peer closed the connection, an error occurred or the receive
+    // timeout passed.
+    size_t receive(char* buffer, size_t size);
+
+    // 0 waits forever.
+    void setReceiveTimeout(std::chrono::milliseconds timeout);
+
+    // Wakes up any thread blocked in accept or receive; the socket is closed on destruction.
+    void shutdown();
+
+private:
+    static constexpr intptr_t invalidHandle = -1;
+
+    explicit Socket(intptr_t handle) : mHandle(handle) {}
+
+    intptr_t mHandle = invalidHandle;
+};
+
+} // namespace legacy_money
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace legacy_money {
+
+struct HistEntry {
+    std::string from;
+    std::string to;
+    long long   money;
+    long long   time;
+    std::string note;
+    std::string currency;
+};
+
+// The outcome of a transfer made with an idempotency key.
+struct KeyedResult {
+    bool ok        = false;
+    bool duplicate = false; // The key had been used before, and ok is the result it had then
+};
+
+struct BalanceSummary {
+    size_t    accounts = 0;
+    long long total    = 0;
+    long long min      = 0;
+    long long max      = 0;
+};
+
+// The operations behind the exported LLMoney_* calls, served either by the local Ledger or by a RemoteLedger that
+// forwards them to the instance owning the database. Errors are thrown.
+// Balances are kept per currency id; the empty id is the default currency used by the single-currency calls.
+class Store {
+public:
+    virtual ~Store() = default;
+
+    virtual long long get(std::string const& currency, std::string const& xuid) = 0;
+
+    virtual bool trans(
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) = 0;
+
+    // Makes the transfer once per key. Later calls with the same key return the first result without touching the
+    // balances, for as long as the ledger remembers the key.
+    virtual KeyedResult transOnce(
+        std::string const& key,
+        std::string const& currency,
+        std::string const& from,
+        std::string const& to,
+        long long          val,
+        std::string const& note
+    ) = 0;
+
+    // The result transOnce() remembers for key, or nothing if the key is unused or expired.
+    virtual std::optional<bool> keyResult(std::string const& key) = 0;
+
+    virtual bool add(std::string const& currency, std::string const& xuid, long long money) = 0;
+
+    virtual bool reduce(std::string const& currency, std::string const& xuid, long long money) = 0;
+
+    virtual bool set(std::string const& currency, std::string const& xuid, long long money) = 0;
+
+    // Takes fromVal of fromCurrency from xuid and gives toVal of toCurrency in one transaction, without tax.
+    virtual bool exchange(
+        std::string const& xuid,
+        std::string const& fromCurrency,
+        long long          fromVal,
+        std::string const& toCurrency,
+        long long          toVal,
+        std::string const& note
+    ) = 0;
+
+    virtual std::vector<std::pair<std::string, long long>> ranking(std::string const& currency, unsigned short num) = 0;
+
+    // Transfers of currency involving xuid with Time > after, newest first. A negative limit returns every match.
+    virtual std::vector<HistEntry>
+    hist(std::string const& currency, std::string const& xuid, long long after, int limit = -1) = 0;
+
+    // Applies to every currency.
+    virtual void clearHist(int difftime) = 0;
+
+    virtual BalanceSummary summary(std::string const& currency) = 0;
+
+    // 0 when wealth is spread evenly, approaching 1 when one account holds all of it.
+    virtual double gini(std::string const& currency) = 0;
+
+    // Number of accounts holding more than threshold.
+    virtual size_t countAbove(std::string const& currency, long long threshold) = 0;
+
+    // Accounts per bucket of equal width over [min, max]; balances outside the range count towards the ends.
+    virtual std::vector<size_t>
+    histogram(std::string const& currency, long long min, long long max, unsigned short buckets) = 0;
+
+    // Hints that the balances of xuid are about to be queried often, and that they no longer are.
+    virtual void prefetch(std::string const& xuid) = 0;
+
+    virtual void release(std::string const& xuid) = 0;
+};
+
+} // namespace legacy_money
@@ -0,0 +1,133 @@
+#include "Trace.h"
+#include "Codec.h"
+#include <cstdlib>
+
+namespace legacy_money {
+
+static constexpr char     traceMagic[8] = {'L', 'M', 'T', 'R', 'A', 'C', 'E', '\0'};
+// Version 2 appended the currency to every record; version 1 traces are read as default currency calls.
+// Version 3 appended the transfer key. Version 4 appended the exchange and histogram fields, which older versions
+// packed into to and xuid, and the veto flag; older traces are read as calls that were never vetoed.
+static constexpr uint32_t traceVersion  = 4;
+
+TraceWriter::TraceWriter(std::filesystem::path const& path)
+: mFile(path, std::ios::binary | std::ios::trunc),
+  mStart(std::chrono::steady_clock::now()) {
+    std::string header(traceMagic, sizeof(traceMagic));
+    codec::putVarint(header, traceVersion);
+    mFile.write(header.data(), (std::streamsize)header.size());
+}
+
+uint64_t TraceWriter::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+void TraceWriter::write(TraceRecord const& record) {
+    std::string body;
+    body.push_back((char)record.op);
+    codec::putVarint(body, record.time);
+    codec::putVarint(body, record.duration);
+    codec::putVarint(body, record.thread);
+    codec::putString(body, record.xuid);
+    codec::putString(body, record.to);
+    codec::putInt(body, record.value);
+    codec::putString(body, record.note);
+    codec::putInt(body, record.result);
+    codec::putString(body, record.currency);
+    codec::putString(body, record.key);
+    codec::putString(body, record.toCurrency);
+    codec::putInt(body, record.toValue);
+    codec::putInt(body, record.min);
+    codec::putInt(body, record.max);
+    codec::putVarint(body, record.vetoed);
+
+    std::string frame;
+    codec::putVarint(frame, body.size());
+    frame += body;
+    std::lock_guard lock{mMutex};
+    mFile.write(frame.data(), (std::streamsize)frame.size());
+}
+
+void TraceWriter::flush() {
+    std::lock_guard lock{mMutex};
+    mFile.flush();
+}
+
+TraceReader::TraceReader(std::filesystem::path const& path) : mFile(path, std::ios::binary) {
+    char magic[sizeof(traceMagic)];
+    if (!mFile.read(magic, sizeof(magic))
+        || std::string_view{magic, sizeof(magic)} != std::string_view{traceMagic, sizeof(traceMagic)}) {
+        return;
+    }
+    for (int shift = 0; mFile; shift += 7) {
+        int byte  = mFile.get();
+        mVersion |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    mValid = mFile.good() && mVersion >= 1 && mVersion <= traceVersion;
+}
+
+// Moves "min:max" out of xuid and "currency:amount" out of to, where traces before version 4 kept them.
+static void unpack(TraceRecord& record) {
+    record.toCurrency.clear();
+    record.toValue = record.min = record.max = 0;
+    record.vetoed  = false;
+    if (record.op == TraceOp::Histogram) {
+        auto colon = record.xuid.find(':');
+        record.min = std::atoll(record.xuid.substr(0, colon).c_str());
+        record.max = colon == std::string::npos ? record.min : std::atoll(record.xuid.substr(colon + 1).c_str());
+        record.xuid.clear();
+    } else if (record.op == TraceOp::Exchange) {
+        auto colon        = record.to.rfind(':');
+        record.toCurrency = record.to.substr(0, colon);
+        record.toValue    = colon == std::string::npos ? 0 : std::atoll(record.to.substr(colon + 1).c_str());
+        record.to.clear();
+    }
+}
+
+bool TraceReader::next(TraceRecord& record) {
+    if (!mValid) {
+        return false;
+    }
+    uint64_t size = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = mFile.get();
+        if (byte == std::ifstream::traits_type::eof()) {
+            return false;
+        }
+        size |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    std::string body(size, '\0');
+    if (!mFile.read(body.data(), (std::streamsize)size)) {
+        return false;
+    }
+    codec::Reader reader{body};
+    record.op       = (TraceOp)reader.getByte();
+    record.time     = reader.getVarint();
+    record.duration = reader.getVarint();
+    record.thread   = (uint32_t)reader.getVarint();
+    record.xuid     = reader.getString();
+    record.to       = reader.getString();
+    record.value    = reader.getInt();
+    record.note     = reader.getString();
+    record.result   = reader.getInt();
+    record.currency = mVersion >= 2 ? reader.getString() : std::string{};
+    record.key      = mVersion >= 3 ? reader.getString() : std::string{};
+    if (mVersion >= 4) {
+        record.toCurrency = reader.getString();
+        record.toValue    = reader.getInt();
+        record.min        = reader.getInt();
+        record.max        = reader.getInt();
+        record.vetoed     = reader.getVarint() != 0;
+    } else {
+        unpack(record);
+    }
+    return reader.ok();
+}
+
+} // namespace legacy_money
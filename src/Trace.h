@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace legacy_money {
+
+enum class TraceOp : uint8_t {
+    Get,
+    Set,
+    Trans,
+    Add,
+    Reduce,
+    GetHist,
+    ClearHist,
+    Ranking,
+    Sum,
+    CountAbove,
+    Gini,
+    Histogram,
+    Exchange,
+    TransOnce,
+    Summary,
+};
+
+// One exported LLMoney_* call. Which fields are meaningful depends on op:
+//   Get(xuid) Set/Add/Reduce(xuid, value) Trans(xuid, to, value, note)
+//   GetHist(xuid, value = timediff) ClearHist(value = difftime) Ranking(value = num)
+//   Sum() CountAbove(value = threshold) Gini() Histogram(min, max, value = buckets)
+//   Exchange(xuid, currency = sold currency, value = sold amount, toCurrency, toValue = bought amount, note)
+//   TransOnce(key, xuid, to, value, note) Summary(), result = accounts
+// Every op but ClearHist applies to currency, empty for the default one. result holds the return value (Gini in
+// millionths), or the size of the returned container. A call refused by a before listener is marked vetoed; it
+// never reached the ledger and its result is 0.
+struct TraceRecord {
+    TraceOp     op;
+    uint64_t    time;     // Nanoseconds since the trace was started
+    uint64_t    duration; // Nanoseconds spent in the call
+    uint32_t    thread;
+    std::string xuid;
+    std::string to;
+    long long   value = 0;
+    std::string note;
+    long long   result = 0;
+    std::string currency;
+    std::string key;
+    std::string toCurrency;
+    long long   toValue = 0;
+    long long   min     = 0;
+    long long   max     = 0;
+    bool        vetoed  = false;
+};
+
+// Appends records to a compact binary file: a fixed header followed by varint-encoded records.
+class TraceWriter {
+public:
+    explicit TraceWriter(std::filesystem::path const& path);
+
+    [[nodiscard]] bool good() const { return mFile.good(); }
+
+    [[nodiscard]] uint64_t now() const;
+
+    void write(TraceRecord const& record);
+
+    void flush();
+
+private:
+    std::ofstream                         mFile;
+    std::mutex                            mMutex;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(std::filesystem::path const& path);
+
+    [[nodiscard]] bool good() const { return mValid; }
+
+    bool next(TraceRecord& record);
+
+private:
+    std::ifstream mFile;
+    bool          mValid   = false;
+    uint64_t      mVersion = 0;
+};
+
+} // namespace legacy_money
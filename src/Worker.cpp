@@ -0,0 +1,62 @@
+#include "Worker.h"
+
+namespace legacy_money {
+
+Worker::Worker() : mThread([this] { run(); }) {}
+
+Worker::~Worker() {
+    {
+        std::lock_guard lock{mMutex};
+        mStopping = true;
+    }
+    mCondition.notify_one();
+    mThread.join();
+}
+
+void Worker::post(std::function<void()> task) {
+    {
+        std::lock_guard lock{mMutex};
+        mTasks.push_back(std::move(task));
+    }
+    mCondition.notify_one();
+}
+
+void Worker::postAt(std::chrono::steady_clock::time_point when, std::function<void()> task) {
+    {
+        std::lock_guard lock{mMutex};
+        mTimers.emplace(when, std::move(task));
+    }
+    mCondition.notify_one();
+}
+
+void Worker::run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{mMutex};
+            for (;;) {
+                auto now = std::chrono::steady_clock::now();
+                while (!mStopping && !mTimers.empty() && mTimers.begin()->first <= now) {
+                    mTasks.push_back(std::move(mTimers.begin()->second));
+                    mTimers.erase(mTimers.begin());
+                }
+                if (mStopping || !mTasks.empty()) {
+                    break;
+                }
+                if (mTimers.empty()) {
+                    mCondition.wait(lock);
+                } else {
+                    mCondition.wait_until(lock, mTimers.begin()->first);
+                }
+            }
+            if (mTasks.empty()) {
+                return;
+            }
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace legacy_money
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace legacy_money {
+
+// A single background thread running posted tasks in order. Pending tasks are still run on destruction, tasks
+// scheduled for later are dropped.
+class Worker {
+public:
+    Worker();
+
+    ~Worker();
+
+    Worker(Worker const&)            = delete;
+    Worker& operator=(Worker const&) = delete;
+
+    void post(std::function<void()> task);
+
+    // Runs task once when is reached, after the tasks already posted by then.
+    void postAt(std::chrono::steady_clock::time_point when, std::function<void()> task);
+
+private:
+    void run();
+
+    std::mutex                                                                  mMutex;
+    std::condition_variable                                                     mCondition;
+    std::deque<std::function<void()>>                                           mTasks;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> mTimers;
+    bool                                                                        mStopping = false;
+    std::thread                                                                 mThread;
+};
+
+} // namespace legacy_money
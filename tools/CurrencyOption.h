@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Ledger.h"
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace legacy_money {
+
+// Parses the value of a --currency option, "id:def_money:pay_tax".
+inline std::optional<std::pair<std::string, Ledger::Options>> parseCurrencyOption(std::string const& value) {
+    auto first = value.find(':'), second = value.find(':', first + 1);
+    if (first == 0 || first == std::string::npos || second == std::string::npos) {
+        return std::nullopt;
+    }
+    Ledger::Options options;
+    options.defMoney = std::atoll(value.substr(first + 1, second - first - 1).c_str());
+    options.payTax   = (float)std::atof(value.substr(second + 1).c_str());
+    return std::pair{value.substr(0, first), options};
+}
+
+} // namespace legacy_money
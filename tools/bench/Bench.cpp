@@ -0,0 +1,76 @@
+#include "Ledger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+using namespace legacy_money;
+
+// Compares the balance column kernels with the SQL queries they replace, on a scratch database.
+template <class F>
+static double measure(F&& task, int rounds = 5) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        task();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / rounds;
+}
+
+int main(int argc, char** argv) {
+    long long             accounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    std::filesystem::path path     = std::filesystem::temp_directory_path() / "LegacyMoneyBench.db";
+    std::filesystem::remove(path);
+    {
+        Ledger ledger{path};
+        ledger.database().exec(
+            "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(accounts)
+            + ") INSERT INTO money (XUID, Money) SELECT 'xuid' || i, abs(random() % 1000000) FROM n"
+        );
+    }
+    Ledger ledger{path};
+    auto&  db = ledger.database();
+    std::printf("%lld accounts, columns built in %.1f ms\n", accounts, measure([&] { ledger.summary({}); }, 1));
+
+    auto sql = [&](std::string const& query) {
+        return measure([&] {
+            SQLite::Statement statement{db, query};
+            while (statement.executeStep()) {}
+        });
+    };
+    long long   sink = 0;
+    std::printf("%-22s %12s %12s\n", "query", "SQL ms", "columns ms");
+    std::printf(
+        "%-22s %12.2f %12.2f\n",
+        "sum",
+        sql("select sum(Money) from money"),
+        measure([&] { sink += ledger.summary({}).total; })
+    );
+    std::printf(
+        "%-22s %12.2f %12.2f\n",
+        "gini",
+        sql("select sum((2 * r - n - 1) * Money) * 1.0 / (n * sum(Money)) from (select Money, row_number() over "
+            "(order by Money) r, count(*) over () n from money)"),
+        measure([&] { sink += (long long)ledger.gini({}); })
+    );
+    std::printf(
+        "%-22s %12.2f %12.2f\n",
+        "count above 500000",
+        sql("select count(*) from money where Money > 500000"),
+        measure([&] { sink += (long long)ledger.countAbove({}, 500000); })
+    );
+    std::printf(
+        "%-22s %12.2f %12.2f\n",
+        "top 10",
+        sql("select * from money order by Money desc limit 10"),
+        measure([&] { sink += (long long)ledger.ranking({}, 10).size(); })
+    );
+    std::printf(
+        "%-22s %12.2f %12.2f\n",
+        "histogram, 10 buckets",
+        sql("select Money / 100000, count(*) from money group by 1"),
+        measure([&] { sink += (long long)ledger.histogram({}, 0, 999999, 10).size(); })
+    );
+    std::filesystem::remove(path);
+    return sink == 0;
+}
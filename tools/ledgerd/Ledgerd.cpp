@@ -0,0 +1,74 @@
+#include "../CurrencyOption.h"
+#include "Ledger.h"
+#include "LedgerServer.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+
+using namespace legacy_money;
+
+static std::atomic<bool> stopping = false;
+
+static void usage() {
+    std::fprintf(
+        stderr,
+        "Usage: LegacyMoneyLedgerd <database> [options]\n"
+        "  --listen <host:port>  Address to serve on (default: 127.0.0.1:25590)\n"
+        "  --def-money <n>       Balance of new accounts (default: 0)\n"
+        "  --pay-tax <f>         Tax rate of player transfers (default: 0.0)\n"
+        "  --currency <id:n:f>   Balance of new accounts and tax rate of another currency, may be repeated\n"
+        "  --key-ttl <s>         Seconds a LLMoney_TransOnce key is remembered, 0 for ever (default: 86400)\n"
+    );
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string                            address = "127.0.0.1:25590";
+    std::map<std::string, Ledger::Options> options;
+    long long                              keyTtl = 24 * 60 * 60;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--listen") {
+            address = value;
+        } else if (arg == "--def-money") {
+            options[{}].defMoney = std::atoll(value.c_str());
+        } else if (arg == "--pay-tax") {
+            options[{}].payTax = (float)std::atof(value.c_str());
+        } else if (arg == "--key-ttl") {
+            keyTtl = std::atoll(value.c_str());
+        } else if (auto currency = parseCurrencyOption(value); arg == "--currency" && currency) {
+            options[currency->first] = currency->second;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    try {
+        Ledger ledger{argv[1]};
+        for (auto const& [currency, currencyOptions] : options) {
+            ledger.setOptions(currency, currencyOptions);
+        }
+        ledger.setKeyTtl(keyTtl);
+        ledger.createIndexes();
+        LedgerServer server{ledger, address};
+        std::printf("Serving %s on %s\n", argv[1], address.c_str());
+        std::fflush(stdout);
+        std::signal(SIGINT, [](int) { stopping = true; });
+        std::signal(SIGTERM, [](int) { stopping = true; });
+        while (!stopping) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
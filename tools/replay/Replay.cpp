@@ -0,0 +1,223 @@
+#include "../CurrencyOption.h"
+#include "Ledger.h"
+#include "RemoteLedger.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace legacy_money;
+
+static char const* opName(TraceOp op) {
+    switch (op) {
+    case TraceOp::Get:
+        return "Get";
+    case TraceOp::Set:
+        return "Set";
+    case TraceOp::Trans:
+        return "Trans";
+    case TraceOp::Add:
+        return "Add";
+    case TraceOp::Reduce:
+        return "Reduce";
+    case TraceOp::GetHist:
+        return "GetHist";
+    case TraceOp::ClearHist:
+        return "ClearHist";
+    case TraceOp::Ranking:
+        return "Ranking";
+    case TraceOp::Sum:
+        return "Sum";
+    case TraceOp::CountAbove:
+        return "CountAbove";
+    case TraceOp::Gini:
+        return "Gini";
+    case TraceOp::Histogram:
+        return "Histogram";
+    case TraceOp::Exchange:
+        return "Exchange";
+    case TraceOp::TransOnce:
+        return "TransOnce";
+    case TraceOp::Summary:
+        return "Summary";
+    }
+    return "Unknown";
+}
+
+static long long execute(Store& ledger, TraceRecord const& record) {
+    auto const& currency = record.currency;
+    switch (record.op) {
+    case TraceOp::Get:
+        return record.xuid.empty() ? -1 : ledger.get(currency, record.xuid);
+    case TraceOp::Set:
+        return !record.xuid.empty() && ledger.set(currency, record.xuid, record.value);
+    case TraceOp::Trans:
+        return ledger.trans(currency, record.xuid, record.to, record.value, record.note);
+    case TraceOp::Add:
+        return !record.xuid.empty() && ledger.add(currency, record.xuid, record.value);
+    case TraceOp::Reduce:
+        return !record.xuid.empty() && ledger.reduce(currency, record.xuid, record.value);
+    case TraceOp::GetHist:
+        return (long long)ledger.hist(currency, record.xuid, std::time(nullptr) - record.value).size();
+    case TraceOp::ClearHist:
+        ledger.clearHist((int)record.value);
+        return 0;
+    case TraceOp::Ranking:
+        return (long long)ledger.ranking(currency, (unsigned short)record.value).size();
+    case TraceOp::Sum:
+        return ledger.summary(currency).total;
+    case TraceOp::CountAbove:
+        return (long long)ledger.countAbove(currency, record.value);
+    case TraceOp::Gini:
+        return (long long)(ledger.gini(currency) * 1e6);
+    case TraceOp::Histogram:
+        return (long long)ledger.histogram(currency, record.min, record.max, (unsigned short)record.value).size();
+    case TraceOp::Exchange:
+        return !record.xuid.empty()
+            && ledger.exchange(record.xuid, currency, record.value, record.toCurrency, record.toValue, record.note);
+    case TraceOp::TransOnce:
+        return ledger.transOnce(record.key, currency, record.xuid, record.to, record.value, record.note).ok;
+    case TraceOp::Summary:
+        return (long long)ledger.summary(currency).accounts;
+    }
+    return 0;
+}
+
+static void usage() {
+    std::fprintf(
+        stderr,
+        "Usage: LegacyMoneyReplay <trace> <database> [options]\n"
+        "  --speed <1|N|max>   Replay at recorded pace, N times faster, or as fast as possible (default: max)\n"
+        "  --output <path>     Copy of the database to replay against (default: <database>.replay)\n"
+        "  --connect <addr>    Replay against a ledger server instead; <database> is then ignored\n"
+        "  --def-money <n>     def_money of the recorded server (default: 0)\n"
+        "  --pay-tax <f>       pay_tax of the recorded server (default: 0.0)\n"
+        "  --currency <id:n:f> def_money and pay_tax of another currency of the recorded server, may be repeated\n"
+    );
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::filesystem::path                  tracePath = argv[1], dbPath = argv[2], outPath = dbPath.string() + ".replay";
+    std::string                            connect;
+    double                                 speed = 0.0;
+    std::map<std::string, Ledger::Options> options;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--speed") {
+            speed = value == "max" ? 0.0 : std::atof(value.c_str());
+        } else if (arg == "--output") {
+            outPath = value;
+        } else if (arg == "--connect") {
+            connect = value;
+        } else if (arg == "--def-money") {
+            options[{}].defMoney = std::atoll(value.c_str());
+        } else if (arg == "--pay-tax") {
+            options[{}].payTax = (float)std::atof(value.c_str());
+        } else if (auto currency = parseCurrencyOption(value); arg == "--currency" && currency) {
+            options[currency->first] = currency->second;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    TraceReader reader{tracePath};
+    if (!reader.good()) {
+        std::fprintf(stderr, "Not a LegacyMoney trace: %s\n", tracePath.string().c_str());
+        return 1;
+    }
+    std::vector<TraceRecord> records;
+    for (TraceRecord record; reader.next(record);) {
+        records.push_back(std::move(record));
+    }
+    std::stable_sort(records.begin(), records.end(), [](auto const& a, auto const& b) { return a.time < b.time; });
+
+    std::unique_ptr<Store> store;
+    if (connect.empty()) {
+        for (auto const* suffix : {"", "-wal", "-shm"}) {
+            std::error_code ec;
+            std::filesystem::remove(outPath.string() + suffix, ec);
+        }
+        // Copied through SQLite rather than as a file, so commits still in economy.db-wal are part of the copy and a
+        // server writing to it meanwhile cannot tear it.
+        if (std::filesystem::exists(dbPath)) {
+            try {
+                SQLite::Database  source{dbPath, SQLite::OPEN_READONLY};
+                SQLite::Statement copy{source, "VACUUM INTO ?"};
+                copy.bind(1, outPath.string());
+                copy.exec();
+            } catch (std::exception const& e) {
+                std::fprintf(stderr, "Failed to prepare %s: %s\n", outPath.string().c_str(), e.what());
+                return 1;
+            }
+        }
+        auto ledger = std::make_unique<Ledger>(outPath);
+        for (auto const& [currency, currencyOptions] : options) {
+            ledger->setOptions(currency, currencyOptions);
+        }
+        ledger->createIndexes();
+        store = std::move(ledger);
+    } else {
+        store = std::make_unique<RemoteLedger>(connect, std::chrono::milliseconds{0}, std::chrono::seconds{30});
+    }
+
+    std::map<TraceOp, std::vector<uint64_t>> latencies;
+    size_t                                   mismatches = 0, errors = 0, vetoed = 0;
+    auto                                     start      = std::chrono::steady_clock::now();
+    for (auto const& record : records) {
+        // A listener refused these on the recorded server, so they never changed anything there.
+        if (record.vetoed) {
+            ++vetoed;
+            continue;
+        }
+        if (speed > 0.0) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds((uint64_t)(record.time / speed)));
+        }
+        auto      begin  = std::chrono::steady_clock::now();
+        long long result = 0;
+        try {
+            result = execute(*store, record);
+        } catch (std::exception const& e) {
+            std::fprintf(stderr, "%s failed: %s\n", opName(record.op), e.what());
+            ++errors;
+        }
+        auto end = std::chrono::steady_clock::now();
+        latencies[record.op].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        if (record.op != TraceOp::GetHist && result != record.result) {
+            ++mismatches;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto replayed = records.size() - vetoed;
+    std::printf("Replayed %zu calls in %.3f s (%.0f calls/s)\n", replayed, elapsed, replayed / elapsed);
+    std::printf("Skipped %zu calls vetoed by a listener on the recorded server\n", vetoed);
+    std::printf("Errors: %zu, results differing from the recording: %zu\n", errors, mismatches);
+    std::printf("%-10s %10s %12s %12s %12s %12s\n", "op", "count", "p50 us", "p95 us", "p99 us", "max us");
+    for (auto& [op, samples] : latencies) {
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double q) { return samples[(size_t)(q * (samples.size() - 1))] / 1000.0; };
+        std::printf(
+            "%-10s %10zu %12.1f %12.1f %12.1f %12.1f\n",
+            opName(op),
+            samples.size(),
+            at(0.50),
+            at(0.95),
+            at(0.99),
+            samples.back() / 1000.0
+        );
+    }
+    return errors ? 2 : 0;
+}
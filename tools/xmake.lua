@@ -0,0 +1,46 @@
+target("LegacyMoneyReplay")
+    set_enabled(has_config("tools"))
+    set_kind("binary")
+    set_languages("c++20")
+    add_packages("sqlitecpp")
+    add_includedirs("$(projectdir)/src")
+    add_files(
+        "$(projectdir)/src/BalanceColumns.cpp",
+        "$(projectdir)/src/Ledger.cpp",
+        "$(projectdir)/src/RemoteLedger.cpp",
+        "$(projectdir)/src/Socket.cpp",
+        "$(projectdir)/src/Trace.cpp",
+        "replay/*.cpp"
+    )
+    if is_plat("windows") then
+        add_syslinks("ws2_32")
+    else
+        add_syslinks("pthread")
+    end
+
+target("LegacyMoneyLedgerd")
+    set_enabled(has_config("tools"))
+    set_kind("binary")
+    set_languages("c++20")
+    add_packages("sqlitecpp")
+    add_includedirs("$(projectdir)/src")
+    add_files(
+        "$(projectdir)/src/BalanceColumns.cpp",
+        "$(projectdir)/src/Ledger.cpp",
+        "$(projectdir)/src/LedgerServer.cpp",
+        "$(projectdir)/src/Socket.cpp",
+        "ledgerd/*.cpp"
+    )
+    if is_plat("windows") then
+        add_syslinks("ws2_32")
+    else
+        add_syslinks("pthread")
+    end
+
+target("LegacyMoneyBench")
+    set_enabled(has_config("tools"))
+    set_kind("binary")
+    set_languages("c++20")
+    add_packages("sqlitecpp")
+    add_includedirs("$(projectdir)/src")
+    add_files("$(projectdir)/src/BalanceColumns.cpp", "$(projectdir)/src/Ledger.cpp", "bench/*.cpp")
@@ -2,7 +2,9 @@ add_rules("mode.debug", "mode.release")
 
 add_repositories("levimc-repo " .. (get_config("levimc_repo") or "https://github.com/LiteLDev/xmake-repo.git"))
 
-if is_config("target_type", "server") then
+if has_config("tools") then
+    -- The standalone tools only need the ledger, so skip LeviLamina entirely.
+elseif is_config("target_type", "server") then
     add_requires("levilamina 45a7ac1faa0ff6d613f19589ee0da43255a09084", {configs = {target_type = "server"}})
 else
     add_requires("levilamina 45a7ac1faa0ff6d613f19589ee0da43255a09084", {configs = {target_type = "client"}})
@@ -11,7 +13,7 @@ end
 add_requires("levibuildscript")
 add_requires("sqlitecpp 3.3.3")
 
-if not has_config("vs_runtime") then
+if is_plat("windows") and not has_config("vs_runtime") then
     set_runtimes("MD")
 end
 
@@ -27,11 +29,21 @@ option("target_type")
     set_values("server", "client")
 option_end()
 
+option("tools")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the standalone ledger tools (replay, ledgerd, bench) instead of the mod")
+option_end()
+
+includes("tools")
+
 target("LegacyMoney")
+    set_enabled(not has_config("tools"))
     add_rules("@levibuildscript/linkrule")
     add_rules("@levibuildscript/modpacker")
     if is_plat("windows") then
         add_defines("NOMINMAX", "UNICODE", "LLMONEY_EXPORTS")
+        add_syslinks("ws2_32")
         set_exceptions("none") -- To avoid conflicts with /EHa.
         add_cxflags( "/EHa", "/utf-8", "/W4", "/w44265", "/w44289", "/w44296", "/w45263", "/w44738", "/w45204")
         add_cxflags(